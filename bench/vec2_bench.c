@@ -0,0 +1,78 @@
+// Integrates ENTITIES bodies for ITERATIONS ticks using the Vec2 ops the game uses,
+// build once per VEC2_PRECISION and compare (./nobuild bench)
+#include <stdio.h>
+#include <stdlib.h>
+#include "vec2.h"
+
+#define ENTITIES 4096
+#define ITERATIONS 2000
+
+#if VEC2_PRECISION == VEC2_DOUBLE
+#define PRECISION_NAME "double"
+#elif VEC2_PRECISION == VEC2_FLOAT
+#define PRECISION_NAME "float"
+#else
+#define PRECISION_NAME "fixed 16.16"
+#endif
+
+typedef struct Body
+{
+  Vec2 pos;
+  Vec2 size;
+  Vec2 vel;
+  Vec2 prev;
+} Body;
+
+static Body bodies[ENTITIES];
+
+int main(void)
+{
+  const SDL_Rect bounds = {0, 0, 960, 720};
+  const vec_t delta = VEC(1.0 / 120);
+  const vec_t damping = VEC(0.8);
+  const vec_t gravity = VEC(38 * 30 / 120.0);
+  const vec_t bounds_x0 = VEC(bounds.x), bounds_x1 = VEC(bounds.x + bounds.w);
+  const vec_t bounds_y1 = VEC(bounds.y + bounds.h);
+
+  srand(1);
+  for (size_t i = 0; i < ENTITIES; i++)
+  {
+    bodies[i].pos = (Vec2){VEC(rand() % 960), VEC(rand() % 720)};
+    bodies[i].size = (Vec2){VEC(30), VEC(30)};
+    bodies[i].vel = (Vec2){VEC(rand() % 240 - 120), VEC(rand() % 240 - 120)};
+  }
+
+  uint64_t start = SDL_GetPerformanceCounter();
+
+  for (size_t n = 0; n < ITERATIONS; n++)
+  {
+    for (size_t i = 0; i < ENTITIES; i++)
+    {
+      Body *body = &bodies[i];
+      body->prev = body->pos;
+      body->vel.y += gravity;
+      body->pos = Vec2_ClampRect(Vec2_Add(body->pos, Vec2_Mul(body->vel, delta)), bounds);
+
+      // Bounce off the bounds, losing some energy like a barrel would
+      if (body->pos.x == bounds_x0 || body->pos.x == bounds_x1)
+        body->vel.x = -body->vel.x;
+      if (body->pos.y == bounds_y1)
+        body->vel.y = -VEC_MUL(body->vel.y, damping);
+
+      if (Vec2_Len(body->vel) > VEC(600))
+        body->vel = Vec2_Mul(Vec2_Normalize(body->vel), VEC(600));
+    }
+  }
+
+  uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+  double ns = elapsed * 1e9 / SDL_GetPerformanceFrequency() / ((double)ENTITIES * ITERATIONS);
+
+  double checksum = 0;
+  for (size_t i = 0; i < ENTITIES; i++)
+    checksum += VEC_TO_DOUBLE(bodies[i].pos.x) + VEC_TO_DOUBLE(bodies[i].pos.y);
+
+  printf("%-12s sizeof(Vec2) %2zu  entity %2zu B  %6.2f ns/update  checksum %.1f\n",
+         PRECISION_NAME, sizeof(Vec2), sizeof(Body), ns, checksum);
+
+  return 0;
+}
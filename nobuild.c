@@ -1,41 +1,102 @@
 #define NOBUILD_IMPLEMENTATION
 #include "nobuild.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 
 #define CC "clang"
-#define CFLAGS "-Wall",                   \
-               "-Wextra",                 \
-               "-Werror",                 \
-               "-Wno-unused-parameter",   \
-               "-Wno-unused-variable",    \
-               "-Wno-format",             \
-               "-fsanitize=address",      \
-               "-std=c99",                \
-               "-O3",                     \
-               "-I./src",                 \
-               "-I/opt/homebrew/include", \
-               "-L/opt/homebrew/lib",     \
-               "-D_THREAD_SAFE",          \
-               "-lsdl2",                  \
-               "-lsdl2_ttf",              \
-               "-lm",                     \
-               "-ldl",                    \
-               "-lpthread"
-
-#define MAIN_FLAGS ""
-#define MAIN_INPUT "./src/main.c", "./src/hotreload.c"
+
+// SDL comes from homebrew on macOS, Linux distributions install it system wide with capitalized library names
+#ifdef __APPLE__
+#define SDL_CFLAGS "-I/opt/homebrew/include", "-D_THREAD_SAFE"
+#define SDL_LIBS "-L/opt/homebrew/lib", "-lsdl2", "-lsdl2_ttf"
+#else
+#define SDL_CFLAGS "-D_REENTRANT"
+#define SDL_LIBS "-lSDL2", "-lSDL2_ttf"
+#endif
+
+#define CFLAGS "-Wall",                 \
+               "-Wextra",               \
+               "-Werror",               \
+               "-Wno-unused-parameter", \
+               "-Wno-unused-variable",  \
+               "-Wno-format",           \
+               "-fsanitize=address",    \
+               "-std=c99",              \
+               "-O3",                   \
+               "-I./src",               \
+               SDL_CFLAGS
+
+// After the inputs, linkers that drop unused libraries only keep what the objects before them need
+#define LIBS SDL_LIBS, "-lm", "-ldl", "-lpthread"
+
+// VEC2_DOUBLE or VEC2_FLOAT, VEC2_FIXED is only supported by bench/vec2_bench.c
+#define PRECISION_FLAGS "-DVEC2_PRECISION=VEC2_DOUBLE"
+
+#define MAIN_INPUT "./src/main.c", "./src/hotreload.c", "./src/watch.c"
 
 #define LIB_FLAGS "-shared", "-fPIC"
-#define LIB_INPUT "./src/game.c", "./src/vec2.c"
+#define LIB_INPUT "./src/game.c", "./src/arena.c", "./src/replay.c", "./src/font.c", "./src/render.c", "./src/triplebuffer.c", "./src/pacer.c", "./src/profile.c", "./src/trace.c", "./src/pack.c", "./src/level.c"
+
+#define TOOL_FLAGS "-Wall", "-Wextra", "-Werror", "-std=c99", "-O2", "-I./src"
+
+// Text levels, compiled into build/ for the pack
+#define LEVEL_INPUT "./assets/level0.kd", "./assets/level1.kd", "./assets/level2.kd", "./assets/level3.kd", "./assets/level4.kd", \
+                    "./assets/level5.kd"
+
+// Everything the game reads from assets/ except the leaderboard, which it writes to, with the levels compiled
+#define PACK_INPUT "./assets/player_idle.bmp", "./assets/player_run.bmp", "./assets/player_jump.bmp",      \
+                   "./assets/player_fall.bmp", "./assets/enemy_idle.bmp", "./assets/woman.bmp",            \
+                   "./assets/barrel.bmp", "./assets/platform.bmp", "./assets/collectible.bmp",             \
+                   "./assets/ladder.bmp", "./assets/heart.bmp", "./assets/slkscr.ttf",                     \
+                   "./build/level0.kdl", "./build/level1.kdl", "./build/level2.kdl", "./build/level3.kdl", \
+                   "./build/level4.kdl", "./build/level5.kdl"
+
+#define BENCH_FLAGS "-Wall",    \
+                    "-Wextra",  \
+                    "-Werror",  \
+                    "-std=c99", \
+                    "-O3",      \
+                    "-I./src",  \
+                    SDL_CFLAGS
+
+#define BENCH_LIBS SDL_LIBS, "-lm"
 
 void build_game(void)
 {
-  CMD(CC, CFLAGS, LIB_FLAGS, LIB_INPUT, "-o", "./build/libgame.so");
+  CMD(CC, CFLAGS, PRECISION_FLAGS, LIB_FLAGS, LIB_INPUT, LIBS, "-o", "./build/libgame.so");
 }
 
 void build_main(void)
 {
-  CMD(CC, CFLAGS, MAIN_FLAGS, MAIN_INPUT, "-o", "./build/king_donkey");
+  CMD(CC, CFLAGS, PRECISION_FLAGS, MAIN_INPUT, LIBS, "-o", "./build/king_donkey");
+}
+
+// levelc writes Entity structs, so it is built with the same headers and precision as the game
+void levels(void)
+{
+  CMD(CC, TOOL_FLAGS, PRECISION_FLAGS, SDL_CFLAGS, "./tools/levelc.c", "./src/level.c", "-o", "./build/levelc");
+  CMD("./build/levelc", "./build", LEVEL_INPUT);
+}
+
+void pack(void)
+{
+  levels();
+  CMD(CC, TOOL_FLAGS, "./tools/pack.c", "-o", "./build/pack");
+  CMD("./build/pack", "./build/assets.pak", PACK_INPUT);
+}
+
+void bench(void)
+{
+  MKDIRS("./build");
+
+  CMD(CC, BENCH_FLAGS, "-DVEC2_PRECISION=VEC2_DOUBLE", "./bench/vec2_bench.c", BENCH_LIBS, "-o", "./build/vec2_bench_double");
+  CMD(CC, BENCH_FLAGS, "-DVEC2_PRECISION=VEC2_FLOAT", "./bench/vec2_bench.c", BENCH_LIBS, "-o", "./build/vec2_bench_float");
+  CMD(CC, BENCH_FLAGS, "-DVEC2_PRECISION=VEC2_FIXED", "./bench/vec2_bench.c", BENCH_LIBS, "-o", "./build/vec2_bench_fixed");
+
+  CMD("./build/vec2_bench_double");
+  CMD("./build/vec2_bench_float");
+  CMD("./build/vec2_bench_fixed");
 }
 
 void build(void)
@@ -44,14 +105,45 @@ void build(void)
 
   build_game();
   build_main();
+  pack();
+}
+
+#define WATCH_INTERVAL_MS 100
+
+int64_t modified(const struct stat *st)
+{
+#ifdef __APPLE__
+  return (int64_t)st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+#else
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+// Newest modification time of the sources in nanoseconds, polled so watching needs nothing but a C compiler
+int64_t sources_mtime(void)
+{
+  int64_t newest = 0;
+
+  FOREACH_FILE_IN_DIR(file, "./src", {
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "./src/%s", file);
+    if (file[0] != '.' && stat(path, &st) == 0 && modified(&st) > newest)
+      newest = modified(&st);
+  });
+
+  return newest;
 }
 
 void print_usage(char *name)
 {
   INFO("Usage: %s <command>", name);
   INFO("  build");
+  INFO("  pack");
   INFO("  watch");
   INFO("  run");
+  INFO("  headless");
+  INFO("  bench");
   INFO("  clean");
   INFO("  update");
   INFO("  help");
@@ -72,21 +164,44 @@ int main(int argc, char **argv)
     {
       build();
     }
+    else if (strcmp(argv[1], "pack") == 0)
+    {
+      MKDIRS("./build");
+      pack();
+    }
     else if (strcmp(argv[1], "run") == 0)
     {
       build();
       CMD("./build/king_donkey");
     }
+    else if (strcmp(argv[1], "headless") == 0)
+    {
+      build();
+      CMD("./build/king_donkey", "--headless", "1000000");
+    }
+    else if (strcmp(argv[1], "bench") == 0)
+    {
+      bench();
+    }
     else if (strcmp(argv[1], "watch") == 0)
     {
+      int64_t built = sources_mtime();
       build();
 
+      // The game reloads build/libgame.so by itself once it has been written
       Cmd cmd = {.line = cstr_array_make("./build/king_donkey", NULL)};
       cmd_run_async(cmd, (Fd *)stdin, (Fd *)stdout);
 
       while (true)
       {
-        CMD("fswatch", "-r", "-1", "./src");
+        nanosleep(&(struct timespec){0, WATCH_INTERVAL_MS * 1000000L}, NULL);
+
+        // Only a save newer than every source the last build saw builds again, so each save reloads the game once
+        int64_t newest = sources_mtime();
+        if (newest <= built)
+          continue;
+
+        built = newest;
         build_game();
       }
     }
@@ -0,0 +1,57 @@
+#include "arena.h"
+#include <SDL2/SDL.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#define ARENA_ALIGN 16
+
+void Arena_Init(Arena *arena, size_t capacity)
+{
+  arena->data = SDL_malloc(capacity);
+  assert(arena->data != NULL);
+  arena->size = 0;
+  arena->capacity = capacity;
+  arena->peak = 0;
+}
+
+void Arena_Free(Arena *arena)
+{
+  SDL_free(arena->data);
+  arena->data = NULL;
+  arena->size = arena->capacity = 0;
+}
+
+void Arena_Reset(Arena *arena)
+{
+  arena->size = 0;
+}
+
+void *Arena_Alloc(Arena *arena, size_t size)
+{
+  size_t offset = (arena->size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  assert(offset + size <= arena->capacity);
+
+  arena->size = offset + size;
+  if (arena->size > arena->peak)
+    arena->peak = arena->size;
+
+  return arena->data + offset;
+}
+
+char *Arena_Printf(Arena *arena, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  assert(len >= 0);
+
+  char *text = Arena_Alloc(arena, len + 1);
+
+  va_start(args, format);
+  vsnprintf(text, len + 1, format, args);
+  va_end(args);
+
+  return text;
+}
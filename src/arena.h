@@ -0,0 +1,18 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator for transient data, everything is released at once by Arena_Reset
+typedef struct Arena
+{
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+  size_t peak;
+} Arena;
+
+void Arena_Init(Arena *arena, size_t capacity);
+void Arena_Free(Arena *arena);
+void Arena_Reset(Arena *arena);
+void *Arena_Alloc(Arena *arena, size_t size);
+char *Arena_Printf(Arena *arena, const char *format, ...);
@@ -0,0 +1,20 @@
+#pragma once
+#include "vector.h"
+#include "vec2.h"
+
+typedef struct Entity
+{
+  Vec2 pos;
+  Vec2 size;
+  Vec2 vel;
+  Vec2 prev; // pos at the start of the current tick, for render interpolation
+} Entity;
+typedef struct Entity Player;
+typedef struct Entity Woman;
+typedef struct Entity Enemy;
+typedef struct Entity Platform;
+typedef struct Entity Collectible;
+typedef struct Entity Ladder;
+typedef struct Entity Barrel;
+
+VECTOR_DECL(Entity)
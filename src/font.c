@@ -0,0 +1,101 @@
+#include "font.h"
+#include <assert.h>
+
+#define GLYPH_PADDING 1
+
+static int glyph_index(char c)
+{
+  return (c >= GLYPH_FIRST && c <= GLYPH_LAST ? c : '?') - GLYPH_FIRST;
+}
+
+void GlyphAtlas_Init(GlyphAtlas *atlas, SDL_Renderer *renderer, TTF_Font *font)
+{
+  SDL_Surface *glyphs[GLYPH_COUNT];
+  int cell_w = 0, cell_h = 0;
+
+  for (int i = 0; i < GLYPH_COUNT; i++)
+  {
+    glyphs[i] = TTF_RenderGlyph_Solid(font, GLYPH_FIRST + i, (SDL_Color){255, 255, 255, 255});
+    assert(glyphs[i] != NULL);
+    TTF_GlyphMetrics(font, GLYPH_FIRST + i, NULL, NULL, NULL, NULL, &atlas->advance[i]);
+
+    cell_w = SDL_max(cell_w, glyphs[i]->w + GLYPH_PADDING);
+    cell_h = SDL_max(cell_h, glyphs[i]->h + GLYPH_PADDING);
+  }
+
+  atlas->width = cell_w * GLYPH_COLUMNS;
+  atlas->height = cell_h * ((GLYPH_COUNT + GLYPH_COLUMNS - 1) / GLYPH_COLUMNS);
+  atlas->line_height = TTF_FontHeight(font);
+
+  SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, atlas->width, atlas->height, 32, SDL_PIXELFORMAT_ARGB8888);
+  assert(surface != NULL);
+  memset(surface->pixels, 0, surface->pitch * surface->h);
+
+  // Solid glyphs are 8-bit with index 0 as the background, copy the rest as opaque white so color comes from the vertices
+  for (int i = 0; i < GLYPH_COUNT; i++)
+  {
+    SDL_Surface *glyph = glyphs[i];
+    SDL_Rect *rect = &atlas->glyphs[i];
+    *rect = (SDL_Rect){(i % GLYPH_COLUMNS) * cell_w, (i / GLYPH_COLUMNS) * cell_h, glyph->w, glyph->h};
+
+    for (int y = 0; y < glyph->h; y++)
+    {
+      uint8_t *src = (uint8_t *)glyph->pixels + y * glyph->pitch;
+      uint32_t *dst = (uint32_t *)((uint8_t *)surface->pixels + (rect->y + y) * surface->pitch) + rect->x;
+      for (int x = 0; x < glyph->w; x++)
+        dst[x] = src[x] ? 0xFFFFFFFF : 0;
+    }
+
+    SDL_FreeSurface(glyph);
+  }
+
+  atlas->texture = SDL_CreateTextureFromSurface(renderer, surface);
+  assert(atlas->texture != NULL);
+  SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+
+  SDL_FreeSurface(surface);
+}
+
+void GlyphAtlas_Free(GlyphAtlas *atlas)
+{
+  if (atlas->texture != NULL)
+    SDL_DestroyTexture(atlas->texture);
+  atlas->texture = NULL;
+}
+
+SDL_Point GlyphAtlas_Measure(GlyphAtlas *atlas, const char *text, float scale)
+{
+  int width = 0;
+  for (const char *c = text; *c; c++)
+    width += atlas->advance[glyph_index(*c)];
+
+  return (SDL_Point){width * scale, atlas->line_height * scale};
+}
+
+// Writes six vertices per character of text and returns the size of the text on screen
+SDL_Point GlyphAtlas_Quads(GlyphAtlas *atlas, const char *text, SDL_Point pos, float scale, SDL_Color color, SDL_Vertex *vertices)
+{
+  float x = pos.x;
+  for (const char *c = text; *c; c++)
+  {
+    int glyph = glyph_index(*c);
+    SDL_Rect *src = &atlas->glyphs[glyph];
+
+    float x0 = x, y0 = pos.y, x1 = x + src->w * scale, y1 = pos.y + src->h * scale;
+    float u0 = (float)src->x / atlas->width, v0 = (float)src->y / atlas->height;
+    float u1 = (float)(src->x + src->w) / atlas->width, v1 = (float)(src->y + src->h) / atlas->height;
+
+    SDL_Vertex *v = vertices;
+    v[0] = (SDL_Vertex){{x0, y0}, color, {u0, v0}};
+    v[1] = (SDL_Vertex){{x1, y0}, color, {u1, v0}};
+    v[2] = (SDL_Vertex){{x1, y1}, color, {u1, v1}};
+    v[3] = (SDL_Vertex){{x0, y0}, color, {u0, v0}};
+    v[4] = (SDL_Vertex){{x1, y1}, color, {u1, v1}};
+    v[5] = (SDL_Vertex){{x0, y1}, color, {u0, v1}};
+    vertices += 6;
+
+    x += atlas->advance[glyph] * scale;
+  }
+
+  return (SDL_Point){x - pos.x, atlas->line_height * scale};
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#define GLYPH_FIRST ' '
+#define GLYPH_LAST '~'
+#define GLYPH_COUNT (GLYPH_LAST - GLYPH_FIRST + 1)
+#define GLYPH_COLUMNS 16
+
+// Printable ASCII rasterized once into a single texture, strings become two triangles per character
+typedef struct GlyphAtlas
+{
+  SDL_Texture *texture;
+  int width;
+  int height;
+  int line_height;
+  SDL_Rect glyphs[GLYPH_COUNT]; // source rect in the atlas
+  int advance[GLYPH_COUNT];
+} GlyphAtlas;
+
+void GlyphAtlas_Init(GlyphAtlas *atlas, SDL_Renderer *renderer, TTF_Font *font);
+void GlyphAtlas_Free(GlyphAtlas *atlas);
+SDL_Point GlyphAtlas_Measure(GlyphAtlas *atlas, const char *text, float scale);
+SDL_Point GlyphAtlas_Quads(GlyphAtlas *atlas, const char *text, SDL_Point pos, float scale, SDL_Color color, SDL_Vertex *vertices);
@@ -1,20 +1,153 @@
+#define _POSIX_C_SOURCE 200809L // st_mtim
+#define _DARWIN_C_SOURCE        // st_mtimespec, which strict POSIX hides on macOS
 #include <assert.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/stat.h>
+
+// Route vector storage through SDL so the allocation counter sees it
+#define VECTOR_MALLOC SDL_malloc
+#define VECTOR_REALLOC SDL_realloc
+#define VECTOR_FREE SDL_free
 #include "game.h"
 
 VECTOR_IMPL(Entity)
 VECTOR_IMPL(FloatingText)
 VECTOR_IMPL(Leaderboard)
+VECTOR_IMPL(DebugLine)
 
 static GameState *gs;
+static Snapshot *ss; // the renderer's view of the simulation
+
+static SDL_malloc_func real_malloc;
+static SDL_calloc_func real_calloc;
+static SDL_realloc_func real_realloc;
+static SDL_free_func real_free;
 
 #define ERect(entity) ((SDL_Rect){(entity).pos.x, (entity).pos.y, (entity).size.x, (entity).size.y})
 #define REAL_LEVEL (gs->level > 0 && gs->level < 4)
-#define LEVEL_COLOR RGB(Colors[gs->level % (sizeof(Colors) / sizeof(Colors[0]))])
+#define HEADLESS (gs->options.headless)
+#define REPLAYING (gs->replay.mode == REPLAY_PLAY)
+#define INPUT(name) ((gs->input >> INPUT_##name) & 1)
+#define LEVEL_COLOR RGB(Colors[ss->level % (sizeof(Colors) / sizeof(Colors[0]))])
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define TILE ((SDL_Point){GRID_SIZE, GRID_SIZE})
+
+// Copies src into dst, growing dst geometrically so publishing snapshots stops allocating
+#define COPY_VECTOR(name, dst, src)                                          \
+  do                                                                         \
+  {                                                                          \
+    if ((dst)->capacity < (src)->size)                                       \
+      name##_vector_reserve((dst), MAX((src)->size, (dst)->capacity * 2));   \
+    if ((src)->size > 0)                                                     \
+      memcpy((dst)->data, (src)->data, sizeof(*(src)->data) * (src)->size); \
+    (dst)->size = (src)->size;                                               \
+  } while (0)
+
+#if PROFILING
+#define ZONE_BEGIN(zone) uint64_t zone##_start = SDL_GetPerformanceCounter()
+#define ZONE_END(zone) zone_add(zone, zone##_start)
+#else
+#define ZONE_BEGIN(zone)
+#define ZONE_END(zone)
+#endif
+
+// Adds the time call takes to a zone of the current tick or frame
+#define ZONE(zone, call) \
+  do                     \
+  {                      \
+    ZONE_BEGIN(zone);    \
+    call;                \
+    ZONE_END(zone);      \
+  } while (0)
+
+void *counting_malloc(size_t size)
+{
+  SDL_AtomicAdd(&gs->allocs, 1);
+  return real_malloc(size);
+}
+
+void *counting_calloc(size_t nmemb, size_t size)
+{
+  SDL_AtomicAdd(&gs->allocs, 1);
+  return real_calloc(nmemb, size);
+}
+
+void *counting_realloc(void *mem, size_t size)
+{
+  SDL_AtomicAdd(&gs->allocs, 1);
+  return real_realloc(mem, size);
+}
+
+// Wraps the allocator SDL (and SDL_ttf) use, must be undone before the library is unloaded
+void hook_allocations(void)
+{
+  SDL_GetMemoryFunctions(&real_malloc, &real_calloc, &real_realloc, &real_free);
+  SDL_SetMemoryFunctions(&counting_malloc, &counting_calloc, &counting_realloc, real_free);
+}
+
+void unhook_allocations(void)
+{
+  SDL_SetMemoryFunctions(real_malloc, real_calloc, real_realloc, real_free);
+}
+
+float elapsed_ms(uint64_t start, uint64_t end)
+{
+  return (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static const char *zone_names[] = {
+#define X(name, label) label,
+    SIM_ZONES
+    RENDER_ZONES
+    TRACE_ZONES
+#undef X
+};
+
+void zone_add(enum Zone zone, uint64_t start)
+{
+  uint64_t end = SDL_GetPerformanceCounter();
+  if (gs->trace.events != NULL)
+    Trace_Add(&gs->trace, zone, start, end);
+
+  if (zone < SIM_ZONE_COUNT)
+    gs->tick_zones[zone] += elapsed_ms(start, end);
+  else if (zone < ZONE_COUNT)
+    gs->frame_zones[zone] += elapsed_ms(start, end);
+}
+
+// Hands the zone timings of the tick that just ran to the renderer, they are dropped while it is behind
+void push_tick_zones(void)
+{
+  uint32_t head = SDL_AtomicGet(&gs->zone_head);
+  if (head - (uint32_t)SDL_AtomicGet(&gs->zone_tail) < ZONE_QUEUE_SIZE)
+  {
+    memcpy(gs->zone_queue[head % ZONE_QUEUE_SIZE], gs->tick_zones, sizeof(gs->tick_zones));
+    SDL_AtomicSet(&gs->zone_head, head + 1);
+  }
+  memset(gs->tick_zones, 0, sizeof(gs->tick_zones));
+}
+
+// Moves the timings of the ticks simulated since the last call and of the previous frame into the rings
+void record_zones(void)
+{
+  uint32_t head = SDL_AtomicGet(&gs->zone_head);
+  for (uint32_t tail = SDL_AtomicGet(&gs->zone_tail); tail != head; tail++)
+  {
+    for (int zone = 0; zone < SIM_ZONE_COUNT; zone++)
+      ProfileRing_Push(&gs->zones[zone], gs->zone_queue[tail % ZONE_QUEUE_SIZE][zone]);
+    SDL_AtomicSet(&gs->zone_tail, tail + 1);
+  }
+
+  for (int zone = SIM_ZONE_COUNT; zone < ZONE_COUNT; zone++)
+    ProfileRing_Push(&gs->zones[zone], gs->frame_zones[zone]);
+  memset(gs->frame_zones, 0, sizeof(gs->frame_zones));
+
+  ProfileRing_Push(&gs->frame_times, gs->delta_unscaled * 1000);
+}
 
 void reset_animations(void)
 {
@@ -29,39 +162,344 @@ void reset_animations(void)
   gs->enemy_throw_cooldown = ENEMY_THROW_COOLDOWN;
 }
 
-SDL_Texture *render_text(const char *text, SDL_Color color)
+Vertex *render_quads(RenderLayer layer, SDL_Texture *texture, size_t quads)
+{
+  return RenderQueue_Triangles(&gs->render, layer, texture, quads * 6);
+}
+
+void write_quad(Vertex *v, SDL_FRect rect, SDL_FRect uv, SDL_Color color)
+{
+  float x0 = rect.x, y0 = rect.y, x1 = rect.x + rect.w, y1 = rect.y + rect.h;
+  float u0 = uv.x, v0 = uv.y, u1 = uv.x + uv.w, v1 = uv.y + uv.h;
+
+  v[0] = (Vertex){{x0, y0}, color, {u0, v0}};
+  v[1] = (Vertex){{x1, y0}, color, {u1, v0}};
+  v[2] = (Vertex){{x1, y1}, color, {u1, v1}};
+  v[3] = (Vertex){{x0, y0}, color, {u0, v0}};
+  v[4] = (Vertex){{x1, y1}, color, {u1, v1}};
+  v[5] = (Vertex){{x0, y1}, color, {u0, v1}};
+}
+
+// Emits text from the glyph atlas and returns its size on screen
+SDL_Point render_text(const char *text, int x, int y, float scale, SDL_Color color)
+{
+  size_t len = strlen(text);
+  if (len == 0)
+    return GlyphAtlas_Measure(&gs->glyphs, text, scale);
+
+  Vertex *vertices = render_quads(gs->layer, gs->glyphs.texture, len);
+  return GlyphAtlas_Quads(&gs->glyphs, text, (SDL_Point){x, y}, scale, color, vertices);
+}
+
+void render_fill(SDL_Rect rect, SDL_Color color)
+{
+  write_quad(render_quads(gs->layer, NULL, 1), (SDL_FRect){rect.x, rect.y, rect.w, rect.h}, (SDL_FRect){0}, color);
+}
+
+void render_copy(SDL_Texture *texture, SDL_Rect rect)
+{
+  write_quad(render_quads(gs->layer, texture, 1), (SDL_FRect){rect.x, rect.y, rect.w, rect.h}, (SDL_FRect){0, 0, 1, 1}, (SDL_Color){255, 255, 255, 255});
+}
+
+// Starts recording into an offscreen texture, the frame's own commands stay queued until game_render() submits them
+void begin_offscreen(SDL_Texture *texture)
+{
+  SDL_SetRenderTarget(gs->renderer, texture);
+  SDL_SetRenderDrawColor(gs->renderer, 0, 0, 0, 0);
+  SDL_RenderClear(gs->renderer);
+
+  gs->offscreen = RenderQueue_Begin(&gs->render);
+}
+
+void end_offscreen(void)
+{
+  gs->draw_calls += RenderQueue_Submit(&gs->render, gs->renderer, gs->offscreen);
+  SDL_SetRenderTarget(gs->renderer, NULL);
+}
+
+FloatingText *show_floating_text(const char *text, Vec2 pos, double duration)
+{
+  FloatingText *floating = FloatingText_vector_push(gs->floating_texts, &(FloatingText){.pos = pos, .duration = duration, .elapsed = 0});
+  snprintf(floating->text, sizeof(floating->text), "%s", text);
+
+  return floating;
+}
+
+// Debug draws go on LAYER_DEBUG of the frame being recorded
+void debug_line(float x0, float y0, float x1, float y1, SDL_Color color)
+{
+  float dx = x1 - x0, dy = y1 - y0;
+  float len = sqrtf(dx * dx + dy * dy);
+  if (len == 0)
+    return;
+
+  // One pixel wide quad around the segment
+  float nx = -dy / len * 0.5f, ny = dx / len * 0.5f;
+  Vertex *v = render_quads(LAYER_DEBUG, NULL, 1);
+  v[0] = (Vertex){{x0 + nx, y0 + ny}, color, {0, 0}};
+  v[1] = (Vertex){{x1 + nx, y1 + ny}, color, {0, 0}};
+  v[2] = (Vertex){{x1 - nx, y1 - ny}, color, {0, 0}};
+  v[3] = (Vertex){{x0 + nx, y0 + ny}, color, {0, 0}};
+  v[4] = (Vertex){{x1 - nx, y1 - ny}, color, {0, 0}};
+  v[5] = (Vertex){{x0 - nx, y0 - ny}, color, {0, 0}};
+}
+
+void debug_rect(SDL_Rect rect, SDL_Color color)
+{
+  float x0 = rect.x + 0.5f, y0 = rect.y + 0.5f, x1 = rect.x + rect.w - 0.5f, y1 = rect.y + rect.h - 0.5f;
+  debug_line(x0, y0, x1, y0, color);
+  debug_line(x1, y0, x1, y1, color);
+  debug_line(x1, y1, x0, y1, color);
+  debug_line(x0, y1, x0, y0, color);
+}
+
+void debug_label(int x, int y, SDL_Color color, const char *format, ...)
+{
+  char text[64];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+
+  RenderLayer layer = gs->layer;
+  gs->layer = LAYER_DEBUG;
+  render_text(text, x, y, 1, color);
+  gs->layer = layer;
+}
+
+// Whether the asset was saved in assets/ while the pack was mapped, the file there is newer than the pack's copy
+bool asset_loose(const char *name)
+{
+  for (uint8_t i = 0; i < gs->loose_asset_count; i++)
+    if (!strcmp(gs->loose_assets[i], name))
+      return true;
+
+  return false;
+}
+
+void add_loose_asset(const char *name)
+{
+  if (gs->pack.data == NULL || asset_loose(name) || strlen(name) >= PACK_NAME_SIZE)
+    return;
+
+  assert(gs->loose_asset_count < SDL_arraysize(gs->loose_assets));
+  strcpy(gs->loose_assets[gs->loose_asset_count++], name);
+}
+
+// The pack's copy of an asset, NULL when it doesn't have one or the file in assets/ replaced it
+const void *pack_asset(const char *name, size_t *size)
 {
-  SDL_Surface *surface = TTF_RenderText_Solid(gs->font, text, color);
-  SDL_Texture *texture = SDL_CreateTextureFromSurface(gs->renderer, surface);
-  SDL_FreeSurface(surface);
+  return asset_loose(name) ? NULL : Pack_Find(&gs->pack, name, size);
+}
 
-  return texture;
+// Assets are read from the mapped pack, or from assets/ when it doesn't have them
+SDL_RWops *open_asset(const char *name)
+{
+  size_t size;
+  const void *data = pack_asset(name, &size);
+  if (data != NULL)
+    return SDL_RWFromConstMem(data, size);
+
+  char path[64];
+  snprintf(path, sizeof(path), "assets/%s", name);
+  return SDL_RWFromFile(path, "rb");
 }
 
-void show_floating_text(const char *text, Vec2 pos, double duration)
+FILE *open_asset_file(const char *name)
 {
-  SDL_Texture *texture = render_text(text, (SDL_Color){255, 255, 255, 255});
+  FILE *file = asset_loose(name) ? NULL : Pack_OpenFile(&gs->pack, name);
+  if (file != NULL)
+    return file;
 
-  FloatingText_vector_push(gs->floating_texts, &(FloatingText){.pos = pos, .duration = duration, .elapsed = 0, .texture = texture});
+  char path[64];
+  snprintf(path, sizeof(path), "assets/%s", name);
+  return fopen(path, "r");
 }
 
-SDL_Texture *load_texture(const char *name)
+SDL_Surface *load_surface(const char *name)
 {
-  size_t filename_len = strlen(name) + 12;
-  char *filename = malloc(filename_len);
-  snprintf(filename, filename_len, "assets/%s.bmp", name);
+  char *filename = Arena_Printf(&gs->frame_arena, "%s.bmp", name);
 
-  SDL_Surface *surface = SDL_LoadBMP(filename);
+  SDL_Surface *surface = SDL_LoadBMP_RW(open_asset(filename), 1);
+  assert(surface != NULL);
   Uint32 key = SDL_MapRGB(surface->format, 0, 0, 0);
   SDL_SetColorKey(surface, SDL_TRUE, key);
+  SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+
+  return surface;
+}
+
+static const char *sprite_names[] = {
+#define X(n, f, d, w) #n,
+    SPRITES
+#undef X
+};
+
+// Modification time in nanoseconds of an asset read from assets/, 0 when it comes from the pack, which can't change while mapped.
+// Whole seconds would miss a second save within the same second.
+int64_t asset_mtime(const char *name)
+{
+  size_t size;
+  if (pack_asset(name, &size) != NULL)
+    return 0;
+
+  char path[64];
+  struct stat st;
+  snprintf(path, sizeof(path), "assets/%s", name);
+  if (stat(path, &st) != 0)
+    return 0;
+#ifdef __APPLE__
+  return (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+// Lays the sheets out in rows of the atlas
+void layout_sprite_atlas(SDL_Surface **sheets)
+{
+  int x = 0, y = 0, row = 0;
+
+  for (size_t i = 0; i < SPRITE_COUNT; i++)
+  {
+    assert(sheets[i]->w <= SPRITE_ATLAS_WIDTH);
+
+    if (x + sheets[i]->w > SPRITE_ATLAS_WIDTH)
+    {
+      x = 0;
+      y += row;
+      row = 0;
+    }
+
+    // One pixel of padding keeps neighbours from bleeding in when sampling at frame edges
+    gs->sprite_regions[i] = (SDL_Rect){x, y, sheets[i]->w, sheets[i]->h};
+    x += sheets[i]->w + 1;
+    row = MAX(row, sheets[i]->h + 1);
+  }
+
+  gs->sprite_atlas_size = (SDL_Point){SPRITE_ATLAS_WIDTH, y + row};
+}
+
+// Uploads changed sheets into their regions of the atlas, the ones that are NULL are left as they are
+void upload_sprite_sheets(SDL_Surface **sheets)
+{
+  for (size_t i = 0; i < SPRITE_COUNT; i++)
+  {
+    if (sheets[i] == NULL)
+      continue;
+
+    // Blitting applies the color key, the keyed pixels stay transparent black
+    SDL_Rect *region = &gs->sprite_regions[i];
+    SDL_Surface *pixels = SDL_CreateRGBSurfaceWithFormat(0, region->w, region->h, 32, SDL_PIXELFORMAT_ARGB8888);
+    assert(pixels != NULL);
+    SDL_FillRect(pixels, NULL, 0);
+    SDL_BlitSurface(sheets[i], NULL, pixels, NULL);
+    SDL_UpdateTexture(gs->sprite_atlas, region, pixels->pixels, pixels->pitch);
+    SDL_FreeSurface(pixels);
+  }
+}
+
+// Packs every sprite sheet into rows of one texture. It survives hot reloads,
+// afterwards only the sheets that changed on disk are decoded and uploaded again.
+void load_sprite_atlas(void)
+{
+  SDL_Surface *sheets[SPRITE_COUNT] = {0};
+  int64_t mtimes[SPRITE_COUNT];
+  bool layout = gs->sprite_atlas == NULL;
+  uint8_t changed = 0;
+
+  for (size_t i = 0; i < SPRITE_COUNT; i++)
+  {
+    mtimes[i] = asset_mtime(Arena_Printf(&gs->frame_arena, "%s.bmp", sprite_names[i]));
+    if (!layout && mtimes[i] == gs->sprite_mtimes[i])
+      continue;
 
-  SDL_Texture *texture = SDL_CreateTextureFromSurface(gs->renderer, surface);
-  assert(texture != NULL);
+    sheets[i] = load_surface(sprite_names[i]);
+    changed++;
+
+    // A sheet that changed size doesn't fit its region any more
+    SDL_Rect *region = &gs->sprite_regions[i];
+    if (sheets[i]->w != region->w || sheets[i]->h != region->h)
+      layout = true;
+  }
+
+  if (layout)
+  {
+    for (size_t i = 0; i < SPRITE_COUNT; i++)
+      if (sheets[i] == NULL)
+        sheets[i] = load_surface(sprite_names[i]);
+
+    layout_sprite_atlas(sheets);
+
+    SDL_Surface *atlas = SDL_CreateRGBSurfaceWithFormat(0, gs->sprite_atlas_size.x, gs->sprite_atlas_size.y, 32, SDL_PIXELFORMAT_ARGB8888);
+    assert(atlas != NULL);
+    SDL_FillRect(atlas, NULL, 0);
+    for (size_t i = 0; i < SPRITE_COUNT; i++)
+      SDL_BlitSurface(sheets[i], NULL, atlas, &gs->sprite_regions[i]);
+
+    if (gs->sprite_atlas != NULL)
+      SDL_DestroyTexture(gs->sprite_atlas);
+    gs->sprite_atlas = SDL_CreateTexture(gs->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, atlas->w, atlas->h);
+    assert(gs->sprite_atlas != NULL);
+    SDL_SetTextureBlendMode(gs->sprite_atlas, SDL_BLENDMODE_BLEND);
+    SDL_UpdateTexture(gs->sprite_atlas, NULL, atlas->pixels, atlas->pitch);
+
+    SDL_FreeSurface(atlas);
+  }
+  else
+  {
+    upload_sprite_sheets(sheets);
+  }
 
-  free(filename);
-  SDL_FreeSurface(surface);
+  for (size_t i = 0; i < SPRITE_COUNT; i++)
+    SDL_FreeSurface(sheets[i]);
+  memcpy(gs->sprite_mtimes, mtimes, sizeof(mtimes));
 
-  return texture;
+  if (changed > 0)
+    SDL_Log("Loaded %u of %u sprite sheets%s", changed, SPRITE_COUNT, layout ? " into a new atlas" : "");
+}
+
+// The frame UVs come from the SPRITES table, so they are worked out again on every reload
+void map_sprite_frames(void)
+{
+  static const uint8_t widths[] = {
+#define X(n, f, d, w) w,
+      SPRITES
+#undef X
+  };
+  const float width = gs->sprite_atlas_size.x, height = gs->sprite_atlas_size.y;
+
+  for (size_t i = 0; i < SPRITE_COUNT; i++)
+  {
+    SDL_Rect *region = &gs->sprite_regions[i];
+    Sprite *sprite = &((Sprite *)&gs->sprites)[i];
+    int frame_w = widths[i] * SPRITE_SIZE;
+    assert(sprite->frames <= SPRITE_MAX_FRAMES && sprite->frames * frame_w <= region->w);
+
+    for (uint8_t f = 0; f < sprite->frames; f++)
+      sprite->uv[f] = (SDL_FRect){(region->x + f * frame_w) / width, region->y / height, frame_w / width, region->h / height};
+  }
+}
+
+// Opens the font and rasterizes its glyphs, again only when the font file changed since
+void load_font(void)
+{
+  int64_t mtime = asset_mtime("slkscr.ttf");
+  if (gs->font != NULL && mtime == gs->font_mtime)
+    return;
+
+  if (gs->font != NULL)
+  {
+    GlyphAtlas_Free(&gs->glyphs);
+    TTF_CloseFont(gs->font);
+  }
+
+  gs->font = TTF_OpenFontRW(open_asset("slkscr.ttf"), 1, GRID_SIZE / 2);
+  assert(gs->font != NULL);
+  GlyphAtlas_Init(&gs->glyphs, gs->renderer, gs->font);
+  gs->font_mtime = mtime;
+
+  SDL_Log("Loaded slkscr.ttf");
 }
 
 int leaderboard_comparator(const Leaderboard *a, const Leaderboard *b)
@@ -84,10 +522,270 @@ void load_leaderboard(void)
   }
 
   Leaderboard_vector_sort(gs->leaderboard, &leaderboard_comparator);
+  gs->leaderboard_version++;
 
   fclose(file);
 }
 
+typedef bool (*grid_predicate)(SDL_Rect *rect, Entity *entity);
+
+bool cell_range(uint16_t cols, uint16_t rows, SDL_Point cell, SDL_Rect *rect, SDL_Rect *range)
+{
+  if (rect->w <= 0 || rect->h <= 0)
+    return false;
+
+  int x0 = rect->x < 0 ? 0 : rect->x / cell.x;
+  int y0 = rect->y < 0 ? 0 : rect->y / cell.y;
+  int x1 = rect->x + rect->w - 1 < 0 ? 0 : (rect->x + rect->w - 1) / cell.x;
+  int y1 = rect->y + rect->h - 1 < 0 ? 0 : (rect->y + rect->h - 1) / cell.y;
+
+  range->x = MIN(x0, cols - 1);
+  range->y = MIN(y0, rows - 1);
+  range->w = MIN(x1, cols - 1) - range->x + 1;
+  range->h = MIN(y1, rows - 1) - range->y + 1;
+
+  return true;
+}
+
+// Buckets entities into cells of the given size covering bounds, storage is only reallocated when a level needs more
+void build_grid(SpatialGrid *grid, Entity_vector *entities, SDL_Point bounds, SDL_Point cell)
+{
+  grid->cell = cell;
+  grid->cols = (bounds.x + cell.x - 1) / cell.x;
+  grid->rows = (bounds.y + cell.y - 1) / cell.y;
+  size_t cells = grid->cols * grid->rows;
+
+  if (grid->cell_capacity < cells)
+  {
+    grid->cell_capacity = cells;
+    grid->cells = SDL_realloc(grid->cells, sizeof(*grid->cells) * (cells + 1));
+    assert(grid->cells != NULL);
+  }
+  memset(grid->cells, 0, sizeof(*grid->cells) * (cells + 1));
+
+  SDL_Rect range;
+  size_t total = 0;
+  for (size_t i = 0; i < entities->size; i++)
+  {
+    if (!cell_range(grid->cols, grid->rows, grid->cell, &ERect(entities->data[i]), &range))
+      continue;
+
+    for (int y = range.y; y < range.y + range.h; y++)
+      for (int x = range.x; x < range.x + range.w; x++)
+        grid->cells[y * grid->cols + x + 1]++;
+
+    total += range.w * range.h;
+  }
+
+  for (size_t c = 0; c < cells; c++)
+    grid->cells[c + 1] += grid->cells[c];
+
+  if (grid->capacity < total)
+  {
+    grid->capacity = total;
+    grid->items = SDL_realloc(grid->items, sizeof(*grid->items) * grid->capacity);
+    assert(grid->items != NULL);
+  }
+
+  // cells[c] is used as the write cursor of cell c and ends up at the start of cell c + 1
+  for (size_t i = 0; i < entities->size; i++)
+  {
+    if (!cell_range(grid->cols, grid->rows, grid->cell, &ERect(entities->data[i]), &range))
+      continue;
+
+    for (int y = range.y; y < range.y + range.h; y++)
+      for (int x = range.x; x < range.x + range.w; x++)
+        grid->items[grid->cells[y * grid->cols + x]++] = i;
+  }
+
+  memmove(&grid->cells[1], &grid->cells[0], sizeof(*grid->cells) * cells);
+  grid->cells[0] = 0;
+}
+
+// Returns the lowest-index entity passing the test, same as a linear scan would
+Entity *query_grid(SpatialGrid *grid, Entity_vector *entities, SDL_Rect *rect, grid_predicate test)
+{
+  SDL_Rect range;
+  if (grid->cells == NULL || !cell_range(grid->cols, grid->rows, grid->cell, rect, &range))
+    return NULL;
+
+  size_t best = entities->size;
+  for (int y = range.y; y < range.y + range.h; y++)
+  {
+    for (int x = range.x; x < range.x + range.w; x++)
+    {
+      size_t cell = y * grid->cols + x;
+      for (uint32_t i = grid->cells[cell]; i < grid->cells[cell + 1]; i++)
+      {
+        uint32_t index = grid->items[i];
+        if (index < best && test(rect, &entities->data[index]))
+          best = index;
+      }
+    }
+  }
+
+  return best < entities->size ? &entities->data[best] : NULL;
+}
+
+void mark_tiles(TileMap *tiles, uint32_t *bits, Entity_vector *entities)
+{
+  SDL_Rect range;
+  for (size_t i = 0; i < entities->size; i++)
+  {
+    if (!cell_range(tiles->cols, tiles->rows, TILE, &ERect(entities->data[i]), &range))
+      continue;
+
+    for (int y = range.y; y < range.y + range.h; y++)
+      for (int x = range.x; x < range.x + range.w; x++)
+        bits[y * tiles->stride + x / 32] |= 1u << (x % 32);
+  }
+}
+
+void build_tilemap(TileMap *tiles)
+{
+  tiles->cols = (gs->level_size.x + GRID_SIZE - 1) / GRID_SIZE;
+  tiles->rows = (gs->level_size.y + GRID_SIZE - 1) / GRID_SIZE;
+  tiles->stride = (tiles->cols + 31) / 32;
+  size_t words = tiles->stride * tiles->rows;
+
+  if (tiles->capacity < words)
+  {
+    tiles->capacity = words;
+    tiles->solid = SDL_realloc(tiles->solid, sizeof(*tiles->solid) * words);
+    tiles->ladder = SDL_realloc(tiles->ladder, sizeof(*tiles->ladder) * words);
+    assert(tiles->solid != NULL && tiles->ladder != NULL);
+  }
+  memset(tiles->solid, 0, sizeof(*tiles->solid) * words);
+  memset(tiles->ladder, 0, sizeof(*tiles->ladder) * words);
+
+  mark_tiles(tiles, tiles->solid, gs->platforms);
+  mark_tiles(tiles, tiles->ladder, gs->ladders);
+
+  tiles->aligned = true;
+  for (size_t i = 0; i < gs->platforms->size; i++)
+  {
+    Platform *platform = &gs->platforms->data[i];
+    if (fmod(platform->pos.x, GRID_SIZE) != 0 || fmod(platform->pos.y, GRID_SIZE) != 0 ||
+        fmod(platform->size.x, GRID_SIZE) != 0 || fmod(platform->size.y, GRID_SIZE) != 0)
+      tiles->aligned = false;
+  }
+}
+
+// Whether any tile of the range has its bit set, tested a word at a time
+bool tiles_any(TileMap *tiles, uint32_t *bits, SDL_Rect *range)
+{
+  int end = range->x + range->w;
+  for (int y = range->y; y < range->y + range->h; y++)
+  {
+    uint32_t *row = &bits[y * tiles->stride];
+    for (int x = range->x; x < end; x = (x | 31) + 1)
+    {
+      int n = MIN(end, (x | 31) + 1) - x;
+      uint32_t mask = (n == 32 ? ~0u : (1u << n) - 1) << (x % 32);
+      if (row[x / 32] & mask)
+        return true;
+    }
+  }
+  return false;
+}
+
+bool tiles_hit(TileMap *tiles, uint32_t *bits, SDL_Rect *rect)
+{
+  SDL_Rect range;
+  if (tiles->solid == NULL || !cell_range(tiles->cols, tiles->rows, TILE, rect, &range))
+    return false;
+
+  return tiles_any(tiles, bits, &range);
+}
+
+void clear_barrels(BarrelStore *barrels)
+{
+  for (size_t i = 0; i < barrels->size; i++)
+    if (++barrels->generation[barrels->slot[i]] == 0)
+      barrels->generation[barrels->slot[i]] = 1;
+
+  for (size_t slot = 0; slot < barrels->capacity; slot++)
+    barrels->index[slot] = slot + 1;
+
+  barrels->free = 0;
+  barrels->size = 0;
+}
+
+void init_barrels(BarrelStore *barrels)
+{
+  barrels->capacity = BARREL_CAPACITY;
+#define X(a)                                                        \
+  barrels->a = SDL_malloc(sizeof(*barrels->a) * barrels->capacity); \
+  assert(barrels->a != NULL);
+  BARREL_FIELDS
+  X(index)
+  X(generation)
+#undef X
+
+  for (size_t slot = 0; slot < barrels->capacity; slot++)
+    barrels->generation[slot] = 1;
+
+  clear_barrels(barrels);
+}
+
+BarrelHandle spawn_barrel(Vec2 pos)
+{
+  BarrelStore *barrels = &gs->barrels;
+  if (barrels->size == barrels->capacity)
+  {
+    dprintf("Barrel pool full\n");
+    return (BarrelHandle){0};
+  }
+
+  uint16_t slot = barrels->free;
+  barrels->free = barrels->index[slot];
+
+  size_t i = barrels->size++;
+  barrels->index[slot] = i;
+  barrels->slot[i] = slot;
+  barrels->x[i] = barrels->px[i] = pos.x;
+  barrels->y[i] = barrels->py[i] = pos.y;
+  barrels->vx[i] = 0;
+  barrels->vy[i] = 0;
+  barrels->dir[i] = 1;
+  barrels->scored[i] = false;
+
+  return (BarrelHandle){.slot = slot, .generation = barrels->generation[slot]};
+}
+
+bool find_barrel(BarrelStore *barrels, BarrelHandle handle, size_t *i)
+{
+  if (handle.generation == 0 || handle.generation != barrels->generation[handle.slot])
+    return false;
+
+  *i = barrels->index[handle.slot];
+  return true;
+}
+
+void move_barrel(BarrelStore *barrels, size_t to, size_t from)
+{
+  if (to == from)
+    return;
+
+#define X(a) barrels->a[to] = barrels->a[from];
+  BARREL_FIELDS
+#undef X
+  barrels->index[barrels->slot[to]] = to;
+}
+
+// O(1): the last barrel takes the place of the removed one, so callers must revisit index i
+void remove_barrel(BarrelStore *barrels, size_t i)
+{
+  uint16_t slot = barrels->slot[i];
+  if (++barrels->generation[slot] == 0)
+    barrels->generation[slot] = 1;
+
+  move_barrel(barrels, i, --barrels->size);
+
+  barrels->index[slot] = barrels->free;
+  barrels->free = slot;
+}
+
 void unload_level()
 {
   reset_animations();
@@ -95,91 +793,142 @@ void unload_level()
   Entity_vector_clear(gs->platforms);
   Entity_vector_clear(gs->collectibles);
   Entity_vector_clear(gs->ladders);
-  Entity_vector_clear(gs->barrels);
+  clear_barrels(&gs->barrels);
   FloatingText_vector_clear(gs->floating_texts);
 
-  Entity_vector_push(gs->platforms, &(Platform){.pos = {0, SCREEN_HEIGHT - GRID_SIZE}, .size = {SCREEN_WIDTH, GRID_SIZE}});
+  // The floor, fit_level() stretches it under the whole level
+  Entity_vector_push(gs->platforms, &(Platform){0});
 }
 
-void load_level(uint8_t level)
+// The level extends to its furthest platform or ladder but is never smaller than the screen
+void fit_level(void)
 {
-  char filename[] = "assets/level0.kd";
-  filename[12] += level;
-
-  dprintf("Loading %s\n", filename);
+  SDL_Point size = {SCREEN_WIDTH, SCREEN_HEIGHT};
 
-  FILE *file = fopen(filename, "r");
-  if (file == NULL)
-    goto error;
+  for (size_t i = 1; i < gs->platforms->size; i++)
+  {
+    Platform *platform = &gs->platforms->data[i];
+    size.x = MAX(size.x, (int)(platform->pos.x + platform->size.x));
+    size.y = MAX(size.y, (int)(platform->pos.y + platform->size.y));
+  }
+  for (size_t i = 0; i < gs->ladders->size; i++)
+  {
+    Ladder *ladder = &gs->ladders->data[i];
+    size.x = MAX(size.x, (int)(ladder->pos.x + ladder->size.x));
+    size.y = MAX(size.y, (int)(ladder->pos.y + ladder->size.y));
+  }
 
-  unload_level();
+  gs->level_size = size;
 
-  char type[16];
-  while (!feof(file))
+  if (gs->platforms->size > 0)
   {
-    fscanf(file, "%s\n", type);
+    Platform *floor = Entity_vector_front(gs->platforms);
+    floor->pos = (Vec2){0, size.y - GRID_SIZE};
+    floor->size = (Vec2){size.x, GRID_SIZE};
+  }
+}
 
-    if (!strcmp(type, "Player"))
-    {
-      fscanf(file, "pos(%lf %lf)\n", &gs->player.pos.x, &gs->player.pos.y);
-      gs->player.pos = Vec2_Mul(gs->player.pos, GRID_SIZE);
+// The template of the level, parsed when it isn't cached yet or its text file was saved since, NULL when it can't be read
+LevelTemplate *level_template(uint8_t level)
+{
+  assert(level < LEVEL_COUNT);
+  LevelTemplate *template = &gs->level_templates[level];
 
-      gs->player.vel = (Vec2){0};
-      gs->player.size = (Vec2){GRID_SIZE, GRID_SIZE * 2};
-    }
-    else if (!strcmp(type, "Woman"))
-    {
-      fscanf(file, "pos(%lf %lf)\n", &gs->woman.pos.x, &gs->woman.pos.y);
-      gs->woman.pos = Vec2_Mul(gs->woman.pos, GRID_SIZE);
+  // The compiled level from the pack is copied straight out of the mapping, the text one is the fallback
+  // and replaces it once it was saved while the game runs
+  char filename[] = "level0.kdl", text[] = "level0.kd";
+  filename[5] += level;
+  text[5] += level;
 
-      gs->woman.vel = (Vec2){0};
-      gs->woman.size = (Vec2){GRID_SIZE * 2, GRID_SIZE * 3};
-    }
-    else if (!strcmp(type, "Enemy"))
-    {
-      fscanf(file, "pos(%lf %lf)\n", &gs->enemy.pos.x, &gs->enemy.pos.y);
-      gs->enemy.pos = Vec2_Mul(gs->enemy.pos, GRID_SIZE);
+  size_t size = 0;
+  const void *compiled = asset_loose(text) ? NULL : Pack_Find(&gs->pack, filename, &size);
+  if (compiled != NULL && !Level_Valid(compiled, size, GRID_SIZE))
+    compiled = NULL;
 
-      gs->enemy.vel = (Vec2){0};
-      gs->enemy.size = (Vec2){GRID_SIZE * 3, GRID_SIZE * 5};
-    }
-    else if (!strcmp(type, "Platform"))
-    {
-      Platform *platform = Entity_vector_push(gs->platforms, &(Platform){0});
+  if (compiled == NULL)
+    filename[sizeof(filename) - 2] = '\0';
 
-      fscanf(file, "pos(%lf %lf)\n", &platform->pos.x, &platform->pos.y);
-      platform->pos = Vec2_Mul(platform->pos, GRID_SIZE);
+  int64_t mtime = compiled != NULL ? 0 : asset_mtime(filename);
 
-      fscanf(file, "size(%lf %lf)\n", &platform->size.x, &platform->size.y);
-      platform->size = Vec2_Mul(platform->size, GRID_SIZE);
-    }
-    else if (!strcmp(type, "Collectible"))
-    {
-      Collectible *collectible = Entity_vector_push(gs->collectibles, &(Collectible){0});
+  if (template->loaded && template->mtime == mtime)
+    return template;
 
-      fscanf(file, "pos(%lf %lf)\n", &collectible->pos.x, &collectible->pos.y);
-      collectible->pos = Vec2_Mul(collectible->pos, GRID_SIZE);
+  FILE *file = NULL;
+  int line = 0;
 
-      collectible->size = (Vec2){GRID_SIZE, GRID_SIZE};
-    }
-    else if (!strcmp(type, "Ladder"))
-    {
-      Ladder *ladder = Entity_vector_push(gs->ladders, &(Ladder){0});
+  if (template->level.platforms == NULL)
+  {
+    template->level.platforms = Entity_vector_new();
+    template->level.ladders = Entity_vector_new();
+    template->level.collectibles = Entity_vector_new();
+  }
+  Entity_vector_clear(template->level.platforms);
+  Entity_vector_clear(template->level.ladders);
+  Entity_vector_clear(template->level.collectibles);
+  template->loaded = false;
 
-      fscanf(file, "pos(%lf %lf)\n", &ladder->pos.x, &ladder->pos.y);
-      ladder->pos = Vec2_Mul(ladder->pos, GRID_SIZE);
+  dprintf("Parsing %s\n", filename);
 
-      fscanf(file, "size(%lf %lf)\n", &ladder->size.x, &ladder->size.y);
-      ladder->size = Vec2_Mul(ladder->size, GRID_SIZE);
-    }
-    else
+  if (compiled != NULL)
+  {
+    Level_Load(&template->level, compiled);
+  }
+  else
+  {
+    file = open_asset_file(filename);
+    if (file == NULL)
+      goto error;
+
+    line = Level_Parse(&template->level, file, GRID_SIZE);
+    if (line != 0)
       goto error;
   }
 
+  template->mtime = mtime;
+  template->loaded = true;
+
+  goto cleanup;
+
+error:
+  if (line != 0)
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to load %s: line %d not understood", filename, line);
+  else
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to load %s", filename);
+cleanup:
+  if (file != NULL)
+    fclose(file);
+
+  return template->loaded ? template : NULL;
+}
+
+// Entering a level copies its template into the live vectors, a level that can't be read leaves the current one as is
+void load_level(uint8_t level)
+{
+  ZONE_BEGIN(ZONE_LOAD_LEVEL);
+
+  LevelTemplate *template = level_template(level);
+  if (template == NULL)
+  {
+    ZONE_END(ZONE_LOAD_LEVEL);
+    return;
+  }
+
+  unload_level();
+
+  Level live = {.platforms = gs->platforms, .ladders = gs->ladders, .collectibles = gs->collectibles};
+  Level_Copy(&live, &template->level);
+
+  gs->player = live.player;
+  gs->woman = live.woman;
+  gs->enemy = live.enemy;
+  gs->player.size = (Vec2){GRID_SIZE, GRID_SIZE * 2};
+  gs->woman.size = (Vec2){GRID_SIZE * 2, GRID_SIZE * 3};
+  gs->enemy.size = (Vec2){GRID_SIZE * 3, GRID_SIZE * 5};
+
   if (level == 0)
   {
     assert(gs->ladders->size > 0);
-    load_leaderboard();
+    ZONE(ZONE_LOAD_LEADERBOARD, load_leaderboard());
   }
   else if (level == 4)
   {
@@ -187,42 +936,48 @@ void load_level(uint8_t level)
   }
 
   gs->level = level;
+  gs->level_version++;
+  gs->collectibles_version++;
+  gs->player.prev = gs->player.pos;
+  gs->woman.prev = gs->woman.pos;
+  gs->enemy.prev = gs->enemy.pos;
+
+  fit_level();
+  build_grid(&gs->platform_grid, gs->platforms, gs->level_size, TILE);
+  build_grid(&gs->ladder_grid, gs->ladders, gs->level_size, TILE);
+  build_tilemap(&gs->tiles);
+
+  ZONE_END(ZONE_LOAD_LEVEL);
+}
 
-  goto cleanup;
+bool overlaps_platform(SDL_Rect *rect, Platform *platform)
+{
+  return SDL_HasIntersection(rect, &ERect(*platform));
+}
 
-error:
-  SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to load %s", filename);
-cleanup:
-  if (file != NULL)
-    fclose(file);
+bool overlaps_ladder(SDL_Rect *rect, Ladder *ladder)
+{
+  SDL_Rect intersection;
+  if (!SDL_IntersectRect(rect, &ERect(*ladder), &intersection))
+    return false;
+
+  return intersection.h >= rect->h / 2.0 && intersection.w >= rect->w / 2.0;
 }
 
 Platform *intersect_platform(Entity *entity)
 {
-  for (size_t i = 0; i < gs->platforms->size; i++)
-  {
-    Platform *platform = &gs->platforms->data[i];
-    if (SDL_HasIntersection(&ERect(*entity), &ERect(*platform)))
-      return platform;
-  }
-  return NULL;
+  if (!tiles_hit(&gs->tiles, gs->tiles.solid, &ERect(*entity)))
+    return NULL;
+
+  return query_grid(&gs->platform_grid, gs->platforms, &ERect(*entity), &overlaps_platform);
 }
 
 Ladder *intersect_ladder(Entity *entity)
 {
-  for (size_t i = 0; i < gs->ladders->size; i++)
-  {
-    Ladder *ladder = &gs->ladders->data[i];
+  if (!tiles_hit(&gs->tiles, gs->tiles.ladder, &ERect(*entity)))
+    return NULL;
 
-    SDL_Rect intersection;
-    if (SDL_IntersectRect(&ERect(gs->player), &ERect(*ladder), &intersection))
-    {
-      if (intersection.h >= gs->player.size.y / 2 && intersection.w >= gs->player.size.x / 2)
-        return ladder;
-    }
-  }
-
-  return NULL;
+  return query_grid(&gs->ladder_grid, gs->ladders, &ERect(*entity), &overlaps_ladder);
 }
 
 #define INTER_LEFT(v) (v.x <= 0)
@@ -243,36 +998,37 @@ Vec2 where_intersection(Entity *a, Entity *b)
     return (Vec2){0};
 }
 
-void update_physic(Entity *entity)
+void collide_platforms(Entity *entity)
 {
-  entity->vel.x *= 0.8f;
-  entity->pos = Vec2_Add(entity->pos, Vec2_Mul(entity->vel, gs->delta));
-
   Platform *platform = intersect_platform(entity);
   if (platform != NULL)
   {
     Vec2 where = where_intersection(entity, platform);
+
+    // Arrow from the entity's centre towards the side it hit
+    debug({
+      float cx = entity->pos.x + entity->size.x / 2, cy = entity->pos.y + entity->size.y / 2;
+      DebugLine line = {{cx, cy}, {cx + where.x * entity->size.x / 2, cy + where.y * entity->size.y / 2}, {255, 255, 0, 255}};
+      DebugLine_vector_push(gs->debug_lines, &line);
+    });
+
     if (INTER_BOTTOM(where))
     {
-      dprintf("entity bottom platform\n");
       entity->pos.y = platform->pos.y - entity->size.y;
       entity->vel.y = 0; // fmin(entity->vel.y, 0);
     }
     else if (INTER_TOP(where))
     {
-      dprintf("entity top platform\n");
       entity->pos.y = platform->pos.y + platform->size.y;
       entity->vel.y = fmax(entity->vel.y, 0);
     }
     else if (INTER_RIGHT(where))
     {
-      dprintf("entity right platform\n");
       entity->pos.x = platform->pos.x - entity->size.x;
       entity->vel.x = 0;
     }
     else if (INTER_LEFT(where))
     {
-      dprintf("entity left platform\n");
       entity->pos.x = platform->pos.x + platform->size.x;
       entity->vel.x = 0;
     }
@@ -281,10 +1037,13 @@ void update_physic(Entity *entity)
   {
     entity->vel.y += GRAVITY * GRID_SIZE * gs->delta;
   }
+}
 
-  if (entity->pos.x > SCREEN_WIDTH - entity->size.x)
+void clamp_to_level(Entity *entity)
+{
+  if (entity->pos.x > gs->level_size.x - entity->size.x)
   {
-    entity->pos.x = SCREEN_WIDTH - entity->size.x;
+    entity->pos.x = gs->level_size.x - entity->size.x;
     entity->vel.x = 0;
   }
   else if (entity->pos.x < 0)
@@ -293,9 +1052,9 @@ void update_physic(Entity *entity)
     entity->vel.x = 0;
   }
 
-  if (entity->pos.y > SCREEN_HEIGHT - entity->size.y)
+  if (entity->pos.y > gs->level_size.y - entity->size.y)
   {
-    entity->pos.y = SCREEN_HEIGHT - entity->size.y;
+    entity->pos.y = gs->level_size.y - entity->size.y;
     entity->vel.y = 0;
   }
   else if (entity->pos.y < 0)
@@ -305,17 +1064,62 @@ void update_physic(Entity *entity)
   }
 }
 
+void update_physic(Entity *entity)
+{
+  entity->vel.x *= 0.8f;
+  entity->pos = Vec2_Add(entity->pos, Vec2_Mul(entity->vel, gs->delta));
+
+  collide_platforms(entity);
+  clamp_to_level(entity);
+}
+
+// Same damping and integration as update_physic(), over all barrels at once
+void integrate_barrels(size_t n, vec_t *restrict x, vec_t *restrict y, vec_t *restrict vx, const vec_t *restrict vy, const vec_t *restrict dir, vec_t delta)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    vx[i] = dir[i] * (BARREL_SPEED * GRID_SIZE) * 0.8f;
+    x[i] += vx[i] * delta;
+    y[i] += vy[i] * delta;
+  }
+}
+
+// Same clamping as clamp_to_level(), written as selects so it vectorizes
+void clamp_barrels(size_t n, vec_t *restrict x, vec_t *restrict y, vec_t *restrict vx, vec_t *restrict vy)
+{
+  const vec_t max_x = gs->level_size.x - BARREL_SIZE;
+  const vec_t max_y = gs->level_size.y - BARREL_SIZE;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    vec_t cx = x[i] < 0 ? 0 : x[i];
+    vec_t cy = y[i] < 0 ? 0 : y[i];
+    cx = cx > max_x ? max_x : cx;
+    cy = cy > max_y ? max_y : cy;
+    vx[i] = cx != x[i] ? 0 : vx[i];
+    vy[i] = cy != y[i] ? 0 : vy[i];
+    x[i] = cx;
+    y[i] = cy;
+  }
+}
+
 bool can_jump(void)
 {
-  Player *player = malloc(sizeof(*player));
-  memcpy(player, &gs->player, sizeof(*player));
-  player->pos.y += 1;
+  SDL_Rect feet = ERect(gs->player);
+  feet.y += feet.h;
+  feet.h = 1;
+
+  if (gs->tiles.aligned)
+    return tiles_hit(&gs->tiles, gs->tiles.solid, &feet);
+
+  Player player = gs->player;
+  player.pos.y += 1;
 
-  Platform *platform = intersect_platform(player);
+  Platform *platform = intersect_platform(&player);
   if (platform == NULL)
     return false;
 
-  return INTER_BOTTOM(where_intersection(player, platform));
+  return INTER_BOTTOM(where_intersection(&player, platform));
 }
 
 bool can_ladder(void)
@@ -323,10 +1127,53 @@ bool can_ladder(void)
   return intersect_ladder(&gs->player) != NULL;
 }
 
+SDL_Rect lerp_rect(Entity *entity)
+{
+  Vec2 pos = Vec2_Lerp(entity->prev, entity->pos, gs->alpha);
+  return (SDL_Rect){pos.x, pos.y, entity->size.x, entity->size.y};
+}
+
+// Moves a rect from level to screen coordinates, returns false when it is outside the view and can be skipped
+bool to_view(SDL_Rect *rect)
+{
+  rect->x -= gs->camera.x;
+  rect->y -= gs->camera.y;
+  return SDL_HasIntersection(rect, &(SDL_Rect){0, 0, SCREEN_WIDTH, SCREEN_HEIGHT});
+}
+
+// Centres the view on the player without showing anything past the level edges
+void update_camera(void)
+{
+  SDL_Rect player = lerp_rect(&ss->player);
+  int x = player.x + player.w / 2 - SCREEN_WIDTH / 2;
+  int y = player.y + player.h / 2 - SCREEN_HEIGHT / 2;
+
+  gs->camera.x = MAX(0, MIN(x, ss->level_size.x - SCREEN_WIDTH));
+  gs->camera.y = MAX(0, MIN(y, ss->level_size.y - SCREEN_HEIGHT));
+}
+
+// Emits a quad from the sprite atlas, flips mirror the texture coordinates instead of needing SDL_RenderCopyEx
+void render_sprite_frame(Sprite *sprite, uint8_t frame, SDL_Rect *rect, SDL_RendererFlip flip)
+{
+  SDL_FRect uv = sprite->uv[frame];
+
+  if (flip & SDL_FLIP_HORIZONTAL)
+  {
+    uv.x += uv.w;
+    uv.w = -uv.w;
+  }
+  if (flip & SDL_FLIP_VERTICAL)
+  {
+    uv.y += uv.h;
+    uv.h = -uv.h;
+  }
+
+  write_quad(render_quads(gs->layer, gs->sprite_atlas, 1), (SDL_FRect){rect->x, rect->y, rect->w, rect->h}, uv, (SDL_Color){255, 255, 255, 255});
+}
+
 void render_sprite_flip(Sprite *sprite, SDL_Rect *rect, SDL_RendererFlip flip)
 {
-  static const double scale = 1.f * GRID_SIZE / SPRITE_SIZE;
-  SDL_RenderCopyEx(gs->renderer, sprite->texture, &(SDL_Rect){sprite->frame * rect->w / scale, 0, rect->w / scale, rect->h / scale}, rect, 0, NULL, flip);
+  render_sprite_frame(sprite, ss->frames[sprite - (Sprite *)&gs->sprites], rect, flip);
 }
 
 void render_sprite(Sprite *sprite, SDL_Rect *rect)
@@ -336,13 +1183,13 @@ void render_sprite(Sprite *sprite, SDL_Rect *rect)
 
 void render_player(void)
 {
-  Vec2 dir = Vec2_Copy(gs->player.vel);
-  if (can_jump())
+  Vec2 dir = Vec2_Copy(ss->player.vel);
+  if (ss->grounded)
     dir.y = 0;
   dir = Vec2_Normalize(dir);
 
   Sprite *sprite = &gs->sprites.player_idle;
-  if (!can_jump())
+  if (!ss->grounded)
   {
     if (dir.y > 0)
       sprite = &gs->sprites.player_fall;
@@ -352,7 +1199,9 @@ void render_player(void)
   else if (dir.x != 0)
     sprite = &gs->sprites.player_run;
 
-  render_sprite_flip(sprite, &ERect(gs->player), dir.x < 0 ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
+  SDL_Rect rect = lerp_rect(&ss->player);
+  if (to_view(&rect))
+    render_sprite_flip(sprite, &rect, dir.x < 0 ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
 }
 
 void render_enemy(void)
@@ -360,196 +1209,420 @@ void render_enemy(void)
   Sprite *sprite = &gs->sprites.enemy_idle;
   // sprite = &gs->sprites.enemy_throw;
 
-  render_sprite(sprite, &ERect(gs->enemy));
+  SDL_Rect rect = lerp_rect(&ss->enemy);
+  if (to_view(&rect))
+    render_sprite(sprite, &rect);
 }
 
 void render_woman(void)
 {
   SDL_RendererFlip flip = SDL_FLIP_NONE;
 
-  if (gs->player.pos.x + gs->player.size.x / 2 < gs->woman.pos.x + gs->woman.size.x / 2)
+  if (ss->player.pos.x + ss->player.size.x / 2 < ss->woman.pos.x + ss->woman.size.x / 2)
     flip = SDL_FLIP_HORIZONTAL;
 
-  render_sprite_flip(&gs->sprites.woman, &ERect(gs->woman), flip);
+  SDL_Rect rect = lerp_rect(&ss->woman);
+  if (to_view(&rect))
+    render_sprite_flip(&gs->sprites.woman, &rect, flip);
 }
 
-void render_platforms(void)
+// Tiles of the platforms overlapping the chunk, relative to its top left
+void render_platforms(size_t chunk, SDL_Rect bounds)
 {
-  for (size_t i = 0; i < gs->platforms->size; i++)
+  SpatialGrid *grid = &gs->chunks.platforms;
+  Sprite *sprite = &gs->sprites.platform;
+
+  for (uint32_t i = grid->cells[chunk]; i < grid->cells[chunk + 1]; i++)
   {
-    Platform platform = *Entity_vector_at(gs->platforms, i);
-    for (uint8_t x = 0; x < platform.size.x / GRID_SIZE; x++)
+    SDL_Rect rect = ERect(*Entity_vector_at(ss->platforms, grid->items[i]));
+    for (int x = MAX(0, (bounds.x - rect.x) / GRID_SIZE); x * GRID_SIZE < rect.w && rect.x + x * GRID_SIZE < bounds.x + bounds.w; x++)
     {
-      SDL_Rect rect = ERect(platform);
-      rect.x += x * GRID_SIZE;
-      rect.w = GRID_SIZE;
+      SDL_Rect tile = {rect.x + x * GRID_SIZE - bounds.x, rect.y - bounds.y, GRID_SIZE, rect.h};
+      render_sprite_frame(sprite, ss->level % sprite->frames, &tile, SDL_FLIP_NONE);
+    }
+  }
+}
 
-      Sprite *sprite = &gs->sprites.platform;
-      sprite->frame = gs->level % sprite->frames;
+void render_ladders(size_t chunk, SDL_Rect bounds)
+{
+  SpatialGrid *grid = &gs->chunks.ladders;
+  Sprite *sprite = &gs->sprites.ladder;
 
-      render_sprite(sprite, &rect);
+  for (uint32_t i = grid->cells[chunk]; i < grid->cells[chunk + 1]; i++)
+  {
+    SDL_Rect rect = ERect(*Entity_vector_at(ss->ladders, grid->items[i]));
+    for (int y = MAX(0, (bounds.y - rect.y) / GRID_SIZE); y * GRID_SIZE < rect.h && rect.y + y * GRID_SIZE < bounds.y + bounds.h; y++)
+    {
+      SDL_Rect tile = {rect.x - bounds.x, rect.y + y * GRID_SIZE - bounds.y, rect.w, GRID_SIZE};
+      render_sprite_frame(sprite, ss->level % sprite->frames, &tile, SDL_FLIP_NONE);
     }
   }
 }
 
-void render_ladders(void)
+void release_chunk(size_t chunk)
 {
-  for (size_t i = 0; i < gs->ladders->size; i++)
+  ChunkMap *chunks = &gs->chunks;
+  SDL_Texture *texture = chunks->textures[chunk];
+  if (texture == NULL)
+    return;
+
+  if (chunks->pooled < CHUNK_POOL_SIZE)
+    chunks->pool[chunks->pooled++] = texture;
+  else
+    SDL_DestroyTexture(texture);
+  chunks->textures[chunk] = NULL;
+}
+
+void release_chunks(SDL_Rect range, SDL_Rect keep)
+{
+  for (int y = range.y; y < range.y + range.h; y++)
+    for (int x = range.x; x < range.x + range.w; x++)
+      if (!SDL_PointInRect(&(SDL_Point){x, y}, &keep))
+        release_chunk(y * gs->chunks.platforms.cols + x);
+}
+
+void free_chunks(void)
+{
+  ChunkMap *chunks = &gs->chunks;
+  release_chunks(chunks->active, (SDL_Rect){0});
+  chunks->active = (SDL_Rect){0};
+
+  while (chunks->pooled > 0)
+    SDL_DestroyTexture(chunks->pool[--chunks->pooled]);
+}
+
+// Bakes a chunk that just came into view, into a texture left behind by one that went out of it if there is one
+void activate_chunk(int x, int y)
+{
+  ChunkMap *chunks = &gs->chunks;
+  size_t chunk = y * chunks->platforms.cols + x;
+
+  SDL_Texture *texture = chunks->pooled > 0 ? chunks->pool[--chunks->pooled] : NULL;
+  if (texture == NULL)
+  {
+    texture = SDL_CreateTexture(gs->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, CHUNK_WIDTH, CHUNK_HEIGHT);
+    assert(texture != NULL);
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+  }
+  chunks->textures[chunk] = texture;
+
+  SDL_Rect bounds = {x * CHUNK_WIDTH, y * CHUNK_HEIGHT, CHUNK_WIDTH, CHUNK_HEIGHT};
+  begin_offscreen(texture);
+  render_platforms(chunk, bounds);
+  render_ladders(chunk, bounds);
+  end_offscreen();
+}
+
+// Platforms and ladders only change in load_level(), so they are baked per chunk and drawn with a copy per visible chunk.
+// Chunks are activated as they come into view and released once the view is CHUNK_MARGIN chunks away from them.
+void render_chunks(void)
+{
+  ChunkMap *chunks = &gs->chunks;
+  const SDL_Point cell = {CHUNK_WIDTH, CHUNK_HEIGHT};
+
+  if (gs->static_dirty || chunks->version != ss->level_version)
   {
-    Ladder ladder = *Entity_vector_at(gs->ladders, i);
-    for (uint8_t i = 0; i < ladder.size.y / GRID_SIZE; i++)
+    release_chunks(chunks->active, (SDL_Rect){0});
+    chunks->active = (SDL_Rect){0};
+
+    build_grid(&chunks->platforms, ss->platforms, ss->level_size, cell);
+    build_grid(&chunks->ladders, ss->ladders, ss->level_size, cell);
+
+    size_t count = chunks->platforms.cols * chunks->platforms.rows;
+    if (chunks->capacity < count)
     {
-      SDL_Rect rect = ERect(ladder);
-      rect.y += i * GRID_SIZE;
-      rect.h = GRID_SIZE;
+      chunks->capacity = count;
+      chunks->textures = SDL_realloc(chunks->textures, sizeof(*chunks->textures) * count);
+      assert(chunks->textures != NULL);
+    }
+    memset(chunks->textures, 0, sizeof(*chunks->textures) * count);
+
+    chunks->version = ss->level_version;
+    gs->static_dirty = false;
+  }
+
+  SDL_Rect visible;
+  cell_range(chunks->platforms.cols, chunks->platforms.rows, cell, &(SDL_Rect){gs->camera.x, gs->camera.y, SCREEN_WIDTH, SCREEN_HEIGHT}, &visible);
 
-      Sprite *sprite = &gs->sprites.ladder;
-      sprite->frame = gs->level % sprite->frames;
+  int x0 = MAX(visible.x - CHUNK_MARGIN, 0), x1 = MIN(visible.x + visible.w + CHUNK_MARGIN, (int)chunks->platforms.cols);
+  int y0 = MAX(visible.y - CHUNK_MARGIN, 0), y1 = MIN(visible.y + visible.h + CHUNK_MARGIN, (int)chunks->platforms.rows);
+  SDL_Rect keep = {x0, y0, x1 - x0, y1 - y0};
 
-      render_sprite(sprite, &rect);
+  release_chunks(chunks->active, keep);
+  chunks->active = keep;
+
+  for (int y = visible.y; y < visible.y + visible.h; y++)
+  {
+    for (int x = visible.x; x < visible.x + visible.w; x++)
+    {
+      if (chunks->textures[y * chunks->platforms.cols + x] == NULL)
+        activate_chunk(x, y);
+
+      SDL_Rect rect = {x * CHUNK_WIDTH - gs->camera.x, y * CHUNK_HEIGHT - gs->camera.y, CHUNK_WIDTH, CHUNK_HEIGHT};
+      render_copy(chunks->textures[y * chunks->platforms.cols + x], rect);
     }
   }
 }
 
 void render_collectibles(void)
 {
-  for (size_t i = 0; i < gs->collectibles->size; i++)
+  for (size_t i = 0; i < ss->collectibles->size; i++)
   {
-    Collectible collectible = *Entity_vector_at(gs->collectibles, i);
-    render_sprite(&gs->sprites.collectible, &ERect(collectible));
+    SDL_Rect rect = ERect(*Entity_vector_at(ss->collectibles, i));
+    if (to_view(&rect))
+      render_sprite(&gs->sprites.collectible, &rect);
   }
 }
 
 void render_barrels(void)
 {
-  for (size_t i = 0; i < gs->barrels->size; i++)
+  for (size_t i = 0; i < ss->barrels->size; i++)
   {
-    Barrel barrel = gs->barrels->data[i];
-    render_sprite_flip(&gs->sprites.barrel, &ERect(barrel), barrel.vel.x < 0 ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
+    Barrel *barrel = Entity_vector_at(ss->barrels, i);
+    SDL_Rect rect = lerp_rect(barrel);
+    if (to_view(&rect))
+      render_sprite_flip(&gs->sprites.barrel, &rect, barrel->vel.x < 0 ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
   }
 }
 
 void render_floating_texts(void)
 {
-  for (size_t i = 0; i < gs->floating_texts->size; i++)
+  for (size_t i = 0; i < ss->floating_texts->size; i++)
   {
-    FloatingText *text = FloatingText_vector_at(gs->floating_texts, i);
+    FloatingText *text = FloatingText_vector_at(ss->floating_texts, i);
+    SDL_Point size = GlyphAtlas_Measure(&gs->glyphs, text->text, 1);
 
-    text->elapsed += gs->delta;
-    if (text->elapsed >= text->duration)
-    {
-      SDL_DestroyTexture(text->texture);
-      FloatingText_vector_erase(gs->floating_texts, i);
-      i--;
-      continue;
-    }
+    SDL_Rect rect = {text->pos.x, text->pos.y, size.x, size.y};
+    if (to_view(&rect))
+      render_text(text->text, rect.x, rect.y, 1, (SDL_Color){255, 255, 255, 255});
+  }
+}
 
-    SDL_Rect rect = {text->pos.x, text->pos.y, 0, 0};
-    SDL_QueryTexture(text->texture, NULL, NULL, &rect.w, &rect.h);
-    SDL_RenderCopy(gs->renderer, text->texture, NULL, &rect);
+// Returns true when the widget has to be redrawn, with its texture bound as the render target
+bool begin_widget(Widget *widget, SDL_Rect rect, const uint32_t key[WIDGET_KEY_SIZE])
+{
+  if (widget->texture != NULL && (widget->rect.w != rect.w || widget->rect.h != rect.h))
+  {
+    SDL_DestroyTexture(widget->texture);
+    widget->texture = NULL;
+  }
+
+  if (widget->texture == NULL)
+  {
+    widget->texture = SDL_CreateTexture(gs->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, rect.w, rect.h);
+    assert(widget->texture != NULL);
+    SDL_SetTextureBlendMode(widget->texture, SDL_BLENDMODE_BLEND);
+    widget->valid = false;
+  }
+
+  widget->rect = rect;
+  if (widget->valid && !memcmp(widget->key, key, sizeof(widget->key)))
+    return false;
+
+  memcpy(widget->key, key, sizeof(widget->key));
+  widget->valid = true;
+
+  begin_offscreen(widget->texture);
+
+  return true;
+}
+
+void end_widget(void)
+{
+  end_offscreen();
+}
+
+void render_widget(Widget *widget)
+{
+  render_copy(widget->texture, widget->rect);
+}
+
+void free_widgets(void)
+{
+  for (uint8_t i = 0; i < sizeof(gs->widgets) / sizeof(Widget); i++)
+  {
+    Widget *widget = &((Widget *)&gs->widgets)[i];
+    if (widget->texture != NULL)
+      SDL_DestroyTexture(widget->texture);
+    widget->texture = NULL;
+    widget->valid = false;
   }
 }
 
 void render_leaderboard(void)
 {
-  SDL_Rect rect = {.x = GRID_SIZE * 14, .y = GRID_SIZE * 4};
   SDL_Color color = {LEVEL_COLOR};
-  SDL_Texture *texture;
-  char text[NAME_LENGTH + 16];
+  const float scale = 1.75;
+  const int line_height = gs->glyphs.line_height * scale;
 
-  uint16_t offset = gs->leaderboard_page * PAGE_SIZE;
-  uint8_t page_size = MIN(PAGE_SIZE, gs->leaderboard->size - offset);
+  SDL_Rect rect = {GRID_SIZE * 14, GRID_SIZE * 4, SCREEN_WIDTH - GRID_SIZE * 14, line_height * (PAGE_SIZE + 1)};
+  const uint32_t key[WIDGET_KEY_SIZE] = {ss->level, ss->leaderboard_page, ss->leaderboard_version, ss->leaderboard_size};
 
-  for (size_t i = 0; i < page_size; i++)
+  if (begin_widget(&gs->widgets.leaderboard, rect, key))
   {
-    Leaderboard *entry = Leaderboard_vector_at(gs->leaderboard, i + offset);
-    snprintf(text, sizeof(text), "%2d. %s - %d", i + offset + 1, entry->name, entry->score);
+    uint16_t offset = ss->leaderboard_page * PAGE_SIZE;
 
-    texture = render_text(text, color);
-    SDL_QueryTexture(texture, NULL, NULL, &rect.w, &rect.h);
-    rect.w *= 1.75;
-    rect.h *= 1.75;
-    rect.y += rect.h;
+    for (size_t i = 0; i < ss->page_size; i++)
+    {
+      Leaderboard *entry = &ss->page[i];
+      char *text = Arena_Printf(&gs->frame_arena, "%2d. %s - %d", i + offset + 1, entry->name, entry->score);
 
-    SDL_RenderCopy(gs->renderer, texture, NULL, &rect);
-    SDL_DestroyTexture(texture);
+      render_text(text, 0, (i + 1) * line_height, scale, color);
+    }
+
+    end_widget();
   }
+
+  render_widget(&gs->widgets.leaderboard);
 }
 
 void render_text_input(void)
 {
-  SDL_Rect rect = {.x = GRID_SIZE * 2, .y = GRID_SIZE * 4};
   SDL_Color color = {LEVEL_COLOR};
-  SDL_Texture *texture;
-  char text[48];
-
-  Leaderboard *entry = Leaderboard_vector_back(gs->leaderboard);
-  snprintf(text, 44, "Enter your name: %s", entry->name);
+  const float scale = 2;
 
-  texture = render_text(text, color);
-  SDL_QueryTexture(texture, NULL, NULL, &rect.w, &rect.h);
-  rect.w *= 2;
-  rect.h *= 2;
-  rect.y += rect.h;
+  char *text = Arena_Printf(&gs->frame_arena, "Enter your name: %s", ss->name);
 
-  SDL_RenderCopy(gs->renderer, texture, NULL, &rect);
-  SDL_DestroyTexture(texture);
+  render_text(text, GRID_SIZE * 2, GRID_SIZE * 4 + gs->glyphs.line_height * scale, scale, color);
 }
 
 void render_ui(void)
 {
   const uint8_t border = 2;
 
-  if (gs->level == 0)
+  if (ss->level == 0)
     return render_leaderboard();
 
-  if (gs->level == 4)
+  if (ss->level == 4)
     return render_text_input();
 
-  gs->play_time += gs->delta;
+  SDL_Rect panel = {SCREEN_WIDTH - border * 2, border * 2, GRID_SIZE * 4, GRID_SIZE * 2};
+  panel.x -= panel.w;
+
+  const uint32_t key[WIDGET_KEY_SIZE] = {ss->level, ss->score, ss->lives, ss->play_time};
+  if (begin_widget(&gs->widgets.hud, panel, key))
+  {
+    SDL_Rect rect = {0, 0, panel.w, panel.h};
+    SDL_Color color = {LEVEL_COLOR};
 
-  SDL_Rect rect = {SCREEN_WIDTH - border * 2, border * 2, GRID_SIZE * 4, GRID_SIZE * 2};
-  rect.x -= rect.w;
+    render_fill(rect, color);
 
-  SDL_SetRenderDrawColor(gs->renderer, RGB(Colors[gs->level % (sizeof(Colors) / sizeof(Colors[0]))]));
-  SDL_RenderFillRect(gs->renderer, &rect);
+    rect.x += border;
+    rect.y += border;
+    rect.w -= border * 2;
+    rect.h -= border * 2;
 
-  rect.x += border;
-  rect.y += border;
-  rect.w -= border * 2;
-  rect.h -= border * 2;
+    render_fill(rect, (SDL_Color){0, 0, 0, 255});
 
-  SDL_SetRenderDrawColor(gs->renderer, 0, 0, 0, 255);
-  SDL_RenderFillRect(gs->renderer, &rect);
+    rect.x += border;
+    rect.y += border;
 
-  rect.x += border;
-  rect.y += border;
+    SDL_Point size;
 
-  SDL_Color color = {LEVEL_COLOR};
-  SDL_Texture *texture;
-  char text[16];
+    size = render_text(Arena_Printf(&gs->frame_arena, "Score %d", ss->score), rect.x, rect.y, 1, color);
 
-  snprintf(text, 16, "Score %d", gs->score);
-  texture = render_text(text, color);
-  SDL_QueryTexture(texture, NULL, NULL, &rect.w, &rect.h);
-  SDL_RenderCopy(gs->renderer, texture, NULL, &rect);
-  SDL_DestroyTexture(texture);
+    rect.y += size.y + border;
 
-  rect.y += rect.h + border;
+    size = render_text(Arena_Printf(&gs->frame_arena, "Lives %d", ss->lives), rect.x, rect.y, 1, color);
 
-  snprintf(text, 16, "Lives %d", gs->lives);
-  texture = render_text(text, color);
-  SDL_QueryTexture(texture, NULL, NULL, &rect.w, &rect.h);
-  SDL_RenderCopy(gs->renderer, texture, NULL, &rect);
-  SDL_DestroyTexture(texture);
+    rect.y += size.y + border;
 
-  rect.y += rect.h + border;
+    render_text(Arena_Printf(&gs->frame_arena, "Time %d:%02d", (int)ss->play_time / 60, (int)ss->play_time % 60), rect.x, rect.y, 1, color);
 
-  snprintf(text, 16, "Time %d:%02d", (int)gs->play_time / 60, (int)gs->play_time % 60);
-  texture = render_text(text, color);
-  SDL_QueryTexture(texture, NULL, NULL, &rect.w, &rect.h);
-  SDL_RenderCopy(gs->renderer, texture, NULL, &rect);
-  SDL_DestroyTexture(texture);
+    end_widget();
+  }
+
+  render_widget(&gs->widgets.hud);
+}
+
+void debug_level_rect(SDL_Rect rect, SDL_Color color)
+{
+  if (to_view(&rect))
+    debug_rect(rect, color);
+}
+
+void render_debug(void)
+{
+  const SDL_Color grid = {255, 0, 0, 96};
+  SDL_Point offset = {gs->camera.x % GRID_SIZE, gs->camera.y % GRID_SIZE};
+  for (int x = -offset.x; x <= SCREEN_WIDTH; x += GRID_SIZE)
+    debug_line(x + 0.5f, 0, x + 0.5f, SCREEN_HEIGHT, grid);
+  for (int y = -offset.y; y <= SCREEN_HEIGHT; y += GRID_SIZE)
+    debug_line(0, y + 0.5f, SCREEN_WIDTH, y + 0.5f, grid);
+
+  SDL_Point mouse = Vec2_ToPoint(gs->mouse.pos);
+  if (gs->mouse.buttons & SDL_BUTTON(SDL_BUTTON_LEFT))
+  {
+    int x = (mouse.x + gs->camera.x) / GRID_SIZE, y = (mouse.y + gs->camera.y) / GRID_SIZE;
+    debug_level_rect((SDL_Rect){x * GRID_SIZE, y * GRID_SIZE, GRID_SIZE, GRID_SIZE}, (SDL_Color){0, 255, 0, 255});
+    debug_label(mouse.x + GRID_SIZE / 2, mouse.y, (SDL_Color){0, 255, 0, 255}, "pos(%d %d)", x, y);
+  }
+
+  for (size_t i = 0; i < ss->platforms->size; i++)
+    debug_level_rect(ERect(*Entity_vector_at(ss->platforms, i)), (SDL_Color){0, 128, 255, 255});
+  for (size_t i = 0; i < ss->ladders->size; i++)
+    debug_level_rect(ERect(*Entity_vector_at(ss->ladders, i)), (SDL_Color){0, 255, 255, 255});
+  for (size_t i = 0; i < ss->collectibles->size; i++)
+    debug_level_rect(ERect(*Entity_vector_at(ss->collectibles, i)), (SDL_Color){255, 255, 0, 255});
+  for (size_t i = 0; i < ss->barrels->size; i++)
+    debug_level_rect(lerp_rect(Entity_vector_at(ss->barrels, i)), (SDL_Color){255, 128, 0, 255});
+
+  debug_level_rect(lerp_rect(&ss->player), (SDL_Color){0, 255, 0, 255});
+  debug_level_rect(lerp_rect(&ss->enemy), (SDL_Color){255, 0, 255, 255});
+  debug_level_rect(lerp_rect(&ss->woman), (SDL_Color){255, 128, 255, 255});
+
+  // Collision normals from the ticks in this snapshot
+  for (size_t i = 0; i < ss->debug_lines->size; i++)
+  {
+    DebugLine *line = DebugLine_vector_at(ss->debug_lines, i);
+    debug_line(line->from.x - gs->camera.x, line->from.y - gs->camera.y, line->to.x - gs->camera.x, line->to.y - gs->camera.y, line->color);
+  }
+
+  debug_label(GRID_SIZE / 2, GRID_SIZE / 2, (SDL_Color){255, 255, 255, 255}, "Allocs %u/frame  Arena %zu/%zu KiB", gs->frame_allocs, gs->frame_arena.peak / 1024, gs->frame_arena.capacity / 1024);
+  debug_label(GRID_SIZE / 2, GRID_SIZE, (SDL_Color){255, 255, 255, 255}, "Draws %u  Commands %u", gs->frame_draw_calls, gs->render_commands);
+  debug_label(GRID_SIZE / 2, GRID_SIZE * 3 / 2, (SDL_Color){255, 255, 255, 255}, "Pacing %s  %.2f ms  jitter %.2f  worst %.2f  late %u", Pacer_ModeName(gs->pacer.mode), gs->pacing.mean, gs->pacing.jitter, gs->pacing.worst, gs->pacing.late);
+}
+
+// Percentiles of every zone over the last PROFILE_HISTORY ticks or frames, and a graph of the frame times
+void render_profiler(void)
+{
+  const SDL_Color white = {255, 255, 255, 255}, gray = {160, 160, 160, 255};
+  const int x = SCREEN_WIDTH - 360, row = GRID_SIZE / 2;
+  const int graph_y = row * (ZONE_COUNT + 3), graph_h = GRID_SIZE * 3;
+
+  gs->layer = LAYER_DEBUG;
+  render_fill((SDL_Rect){x - row / 2, row / 2, SCREEN_WIDTH - x, graph_y + graph_h}, (SDL_Color){0, 0, 0, 192});
+
+  debug_label(x, row, white, "ms");
+  const char *columns[] = {"p50", "p95", "p99", "max"};
+  for (int c = 0; c < 4; c++)
+    debug_label(x + 170 + c * 45, row, white, "%s", columns[c]);
+
+  float *scratch = Arena_Alloc(&gs->frame_arena, sizeof(float) * PROFILE_HISTORY);
+  for (int zone = 0; zone < ZONE_COUNT; zone++)
+  {
+    ProfileStats stats = ProfileRing_Stats(&gs->zones[zone], scratch);
+    int y = row * (zone + 2);
+    debug_label(x, y, zone < SIM_ZONE_COUNT ? gray : white, "%s", zone_names[zone]);
+    debug_label(x + 170, y, white, "%.2f", stats.p50);
+    debug_label(x + 215, y, white, "%.2f", stats.p95);
+    debug_label(x + 260, y, white, "%.2f", stats.p99);
+    debug_label(x + 305, y, white, "%.2f", stats.max);
+  }
+
+  // One bar per frame, newest on the right, scaled so that twice the paced frame time fills the graph
+  double period = gs->pacer.period > 0 ? 1000.0 * gs->pacer.period / gs->pacer.frequency : 1000.0 / FRAME_RATE;
+  int bottom = graph_y + graph_h;
+  for (uint32_t age = 0; age < PROFILE_HISTORY && age < gs->frame_times.count; age++)
+  {
+    float ms = ProfileRing_Get(&gs->frame_times, age);
+    float h = fminf(ms / (period * 2), 1) * graph_h;
+    SDL_Color color = ms <= period * 1.1 ? (SDL_Color){0, 255, 0, 255} : ms <= period * PACER_LATE ? (SDL_Color){255, 255, 0, 255} : (SDL_Color){255, 0, 0, 255};
+    float bar = SCREEN_WIDTH - row / 2 - age - 0.5f;
+    debug_line(bar, bottom, bar, bottom - h, color);
+  }
+  debug_line(x, bottom - graph_h / 2 + 0.5f, SCREEN_WIDTH - row / 2, bottom - graph_h / 2 + 0.5f, gray);
+  debug_label(x, graph_y, gray, "frame %.2f ms", ProfileRing_Get(&gs->frame_times, 0));
 }
 
 void game_render(void)
@@ -557,35 +1630,33 @@ void game_render(void)
   assert(gs->renderer != NULL);
   assert(gs->keyboard != NULL);
 
-  debug({
-    for (uint8_t y = 0; y < SCREEN_HEIGHT / GRID_SIZE; y++)
-    {
-      for (uint8_t x = 0; x < SCREEN_WIDTH / GRID_SIZE; x++)
-      {
-        SDL_Rect rect = {x * GRID_SIZE, y * GRID_SIZE, GRID_SIZE, GRID_SIZE};
-        SDL_Point point = Vec2_ToPoint(gs->mouse.pos);
+  update_camera();
 
-        SDL_SetRenderDrawColor(gs->renderer, 255, 0, 0, 255);
-        if (gs->mouse.buttons & SDL_BUTTON(SDL_BUTTON_LEFT) && SDL_PointInRect(&point, &rect))
-        {
-          SDL_SetRenderDrawColor(gs->renderer, 0, 255, 0, 255);
-          dprintf("pos(%d %d)\n", x, y);
-        }
+  gs->layer = LAYER_STATIC;
+  ZONE(ZONE_RENDER_CHUNKS, render_chunks());
 
-        SDL_RenderDrawRect(gs->renderer, &rect);
-      }
-    }
-  });
+  gs->layer = LAYER_WORLD;
+  ZONE(ZONE_RENDER_COLLECTIBLES, render_collectibles());
+  ZONE(ZONE_RENDER_BARRELS, render_barrels());
+
+  gs->layer = LAYER_UI;
+  ZONE(ZONE_RENDER_UI, render_ui());
+
+  gs->layer = LAYER_CHARACTERS;
+  ZONE(ZONE_RENDER_WOMAN, render_woman());
+  ZONE(ZONE_RENDER_ENEMY, render_enemy());
+  ZONE(ZONE_RENDER_PLAYER, render_player());
+
+  gs->layer = LAYER_TEXT;
+  ZONE(ZONE_RENDER_FLOATING_TEXTS, render_floating_texts());
 
-  render_platforms();
-  render_ladders();
-  render_collectibles();
-  render_barrels();
-  render_ui();
-  render_woman();
-  render_enemy();
-  render_player();
-  render_floating_texts();
+  ZONE(ZONE_RENDER_DEBUG, debug(render_debug()));
+
+  if (gs->profiler)
+    render_profiler();
+
+  gs->render_commands = gs->render.commands->size;
+  ZONE(ZONE_SUBMIT, gs->draw_calls += RenderQueue_Submit(&gs->render, gs->renderer, (RenderPass){0}));
 }
 
 void new_game(void)
@@ -607,15 +1678,35 @@ void update_menu(void)
 
 void update_sprites(void)
 {
-  for (uint8_t i = 0; i < sizeof(gs->sprites) / sizeof(Sprite); i++)
+  for (uint8_t i = 0; i < sizeof(gs->sprites) / sizeof(Sprite); i++)
+  {
+    Sprite *sprite = &((Sprite *)&gs->sprites)[i];
+    sprite->elapsed += gs->delta * 1000;
+    if (sprite->elapsed >= sprite->duration)
+    {
+      sprite->elapsed = 0;
+      sprite->frame = (sprite->frame + 1) % sprite->frames;
+    }
+  }
+}
+
+void update_floating_texts(void)
+{
+  for (size_t i = 0; i < gs->floating_texts->size; i++)
   {
-    Sprite *sprite = &((Sprite *)&gs->sprites)[i];
-    sprite->elapsed += gs->delta * 1000;
-    if (sprite->elapsed >= sprite->duration)
+    FloatingText *text = FloatingText_vector_at(gs->floating_texts, i);
+
+    text->elapsed += gs->delta;
+    if (text->elapsed >= text->duration)
     {
-      sprite->elapsed = 0;
-      sprite->frame = (sprite->frame + 1) % sprite->frames;
+      FloatingText_vector_erase(gs->floating_texts, i);
+      i--;
+      continue;
     }
+
+    size_t barrel;
+    if (find_barrel(&gs->barrels, text->barrel, &barrel))
+      text->pos = (Vec2){gs->barrels.x[barrel], gs->barrels.y[barrel] - GRID_SIZE / 2};
   }
 }
 
@@ -639,46 +1730,73 @@ void update_enemy(void)
   else
   {
     gs->enemy_throw_cooldown = ENEMY_THROW_COOLDOWN;
-    Entity_vector_push(gs->barrels, &(Barrel){.pos = Vec2_Add(gs->enemy.pos, (Vec2){GRID_SIZE, GRID_SIZE}), .size = {GRID_SIZE, GRID_SIZE}});
+
+    spawn_barrel(Vec2_Add(gs->enemy.pos, (Vec2){GRID_SIZE, GRID_SIZE}));
   }
 }
 
 void update_barrels(void)
 {
-  for (size_t i = 0; i < gs->barrels->size; i++)
+  BarrelStore *barrels = &gs->barrels;
+  SDL_Rect player = ERect(gs->player);
+  bool on_ladder = intersect_ladder(&gs->player) != NULL;
+
+  for (size_t i = 0; i < barrels->size;)
   {
-    Barrel *barrel = &gs->barrels->data[i];
-    SDL_Rect rect = ERect(*barrel);
+    SDL_Rect rect = {barrels->x[i], barrels->y[i], BARREL_SIZE, BARREL_SIZE};
 
-    if (SDL_HasIntersection(&rect, &ERect(gs->player)))
+    if (SDL_HasIntersection(&rect, &player))
     {
-      Entity_vector_erase(gs->barrels, i);
+      remove_barrel(barrels, i);
       gs->lives--;
       continue;
     }
-    else if (barrel->size.x == GRID_SIZE && intersect_ladder(&gs->player) == NULL)
+    else if (!barrels->scored[i] && !on_ladder)
     {
-      rect.y -= barrel->size.y * 2;
-      rect.h += barrel->size.y;
-      if (SDL_HasIntersection(&rect, &ERect(gs->player)))
+      rect.y -= BARREL_SIZE * 2;
+      rect.h += BARREL_SIZE;
+      if (SDL_HasIntersection(&rect, &player))
       {
         gs->score += BARREL_SCORE;
-        barrel->size.x += 0.00001;
-        show_floating_text(STR(BARREL_SCORE), Vec2_Add(barrel->pos, (Vec2){0, -GRID_SIZE / 2}), 1);
+        barrels->scored[i] = true;
+        FloatingText *text = show_floating_text(STR(BARREL_SCORE), (Vec2){barrels->x[i], barrels->y[i] - GRID_SIZE / 2}, 1);
+        text->barrel = (BarrelHandle){.slot = barrels->slot[i], .generation = barrels->generation[barrels->slot[i]]};
       }
     }
 
-    double prev = barrel->vel.x = BARREL_SPEED * GRID_SIZE * (barrel->vel.x < 0 ? -1 : 1);
+    i++;
+  }
 
-    update_physic(barrel);
+  size_t n = barrels->size;
+  integrate_barrels(n, barrels->x, barrels->y, barrels->vx, barrels->vy, barrels->dir, gs->delta);
 
-    if (barrel->vel.x == 0)
-    {
-      barrel->vel.x = -prev;
+  for (size_t i = 0; i < n; i++)
+  {
+    Barrel barrel = {.pos = {barrels->x[i], barrels->y[i]}, .size = {BARREL_SIZE, BARREL_SIZE}, .vel = {barrels->vx[i], barrels->vy[i]}};
+    collide_platforms(&barrel);
+
+    barrels->x[i] = barrel.pos.x;
+    barrels->y[i] = barrel.pos.y;
+    barrels->vx[i] = barrel.vel.x;
+    barrels->vy[i] = barrel.vel.y;
+  }
+
+  clamp_barrels(n, barrels->x, barrels->y, barrels->vx, barrels->vy);
 
-      if (barrel->pos.y >= Entity_vector_at(gs->platforms, 1)->pos.y)
-        Entity_vector_erase(gs->barrels, i);
+  // Barrels stopped by a wall roll back, unless they already reached the bottom floor
+  for (size_t i = 0; i < barrels->size;)
+  {
+    if (barrels->vx[i] == 0)
+    {
+      barrels->dir[i] = -barrels->dir[i];
+      if (barrels->y[i] >= Entity_vector_at(gs->platforms, 1)->pos.y)
+      {
+        remove_barrel(barrels, i);
+        continue;
+      }
     }
+
+    i++;
   }
 }
 
@@ -694,6 +1812,7 @@ void update_collectibles(void)
     {
       show_floating_text(STR(COLLECTIBLE_SCORE), collectible->pos, 1);
       Entity_vector_erase(gs->collectibles, i);
+      gs->collectibles_version++;
       gs->score += COLLECTIBLE_SCORE;
       i--;
       break;
@@ -706,12 +1825,12 @@ void update_player(void)
   if (gs->level != 4)
   {
     Vec2 dir = {
-        .x = gs->keyboard[SDL_SCANCODE_D] - gs->keyboard[SDL_SCANCODE_A],
-        .y = gs->keyboard[SDL_SCANCODE_S] - gs->keyboard[SDL_SCANCODE_W]};
+        .x = INPUT(RIGHT) - INPUT(LEFT),
+        .y = INPUT(DOWN) - INPUT(UP)};
 
     gs->player.vel.x = dir.x * PLAYER_SPEED * GRID_SIZE;
 
-    if (gs->keyboard[SDL_SCANCODE_SPACE] && can_jump())
+    if (INPUT(JUMP) && can_jump())
       gs->player.vel.y = -PLAYER_JUMP * GRID_SIZE;
 
     if (can_ladder())
@@ -739,51 +1858,434 @@ void handle_text_input(SDL_Keycode key)
   }
   else if (key == SDLK_RETURN)
   {
+    if (REPLAYING)
+      return load_level(0);
+
     FILE *file = fopen("assets/leaderboard.kd", "a");
     fprintf(file, "\n%d %s", entry->score, entry->name);
     fclose(file);
 
     load_level(0);
   }
-  else if (len < NAME_LENGTH && isalnum(key))
+  else if (len < NAME_LENGTH && key < 128 && isalnum(key))
   {
     entry->name[len] = key;
   }
 }
 
+// Keys that change the simulation, applied between ticks and recorded in replays
+void handle_key(SDL_Keycode key)
+{
+  if (gs->level == 4)
+    return handle_text_input(key);
+
+  switch (key)
+  {
+  case SDLK_LEFTBRACKET:
+    gs->score -= 100;
+    break;
+  case SDLK_RIGHTBRACKET:
+    gs->score += 100;
+    break;
+  case SDLK_BACKSLASH:
+    gs->lives = 3;
+    break;
+  case SDLK_1:
+  case SDLK_2:
+  case SDLK_3:
+  case SDLK_4:
+  case SDLK_5:
+    load_level(key - SDLK_0);
+    break;
+  case SDLK_n:
+    new_game();
+    break;
+  case SDLK_m:
+    load_level(0);
+    break;
+  case SDLK_r:
+    load_level(gs->level);
+    break;
+  case SDLK_f:
+    show_floating_text("Floating text", gs->player.pos, 2);
+    break;
+  }
+}
+
+// Compare these lines between a recording and its replay to check they stayed in sync
+void log_replay_state(const char *when)
+{
+  SDL_Log("REPLAY: %s at tick %llu (level %d, score %d, lives %d, player %.3f %.3f, barrels %zu)",
+          when, gs->tick, gs->level, gs->score, gs->lives,
+          VEC_TO_DOUBLE(gs->player.pos.x), VEC_TO_DOUBLE(gs->player.pos.y), gs->barrels.size);
+}
+
+// Takes the INPUT_* bits last sampled from the keyboard, or from the replay along with the keys recorded before this tick
+void read_input(void)
+{
+  bool auto_restart = REPLAYING ? gs->replay.flags & REPLAY_AUTO_RESTART : HEADLESS;
+  if (auto_restart && !REAL_LEVEL)
+  {
+    // Nobody enters a name, so the entry the game over added would pile up over a long run
+    if (gs->level == 4)
+      Leaderboard_vector_pop(gs->leaderboard);
+    new_game();
+  }
+
+  while (REPLAYING)
+  {
+    int32_t key;
+    ReplayStep step = Replay_Next(&gs->replay, &gs->input, &key);
+    if (step == REPLAY_INPUT)
+      return;
+
+    if (step == REPLAY_KEY)
+    {
+      handle_key(key);
+      continue;
+    }
+
+    log_replay_state("finished");
+    Replay_Close(&gs->replay);
+  }
+
+  gs->input = SDL_AtomicGet(&gs->live_input);
+
+  if (gs->replay.mode == REPLAY_RECORD)
+    Replay_Input(&gs->replay, gs->input);
+}
+
+void game_tick(void)
+{
+  read_input();
+
+  gs->tick++;
+
+  gs->player.prev = gs->player.pos;
+  gs->woman.prev = gs->woman.pos;
+  gs->enemy.prev = gs->enemy.pos;
+  memcpy(gs->barrels.px, gs->barrels.x, sizeof(*gs->barrels.x) * gs->barrels.size);
+  memcpy(gs->barrels.py, gs->barrels.y, sizeof(*gs->barrels.y) * gs->barrels.size);
+
+  ZONE(ZONE_UPDATE_SPRITES, update_sprites());
+  update_menu();
+
+  if (!REAL_LEVEL)
+    update_physic(&gs->woman);
+  else
+    gs->play_time += gs->delta;
+
+  ZONE(ZONE_UPDATE_COLLECTIBLES, update_collectibles());
+  ZONE(ZONE_UPDATE_BARRELS, update_barrels());
+  ZONE(ZONE_UPDATE_ENEMY, update_enemy());
+  ZONE(ZONE_UPDATE_PLAYER, update_player());
+  update_floating_texts();
+
+  if (REAL_LEVEL && gs->lives == 0)
+    load_level(4);
+
+  push_tick_zones();
+}
+
+// Keys that change how the simulation runs rather than what happens in it, never recorded
+bool handle_control_key(SDL_Keycode key)
+{
+  switch (key)
+  {
+  case SDLK_PLUS:
+  case SDLK_EQUALS:
+    gs->time_scale = fmin(gs->time_scale + (gs->time_scale < 1.0f ? 0.1f : 0.5f), TIME_SCALE_MAX);
+    SDL_Log("Time scale: %lf", gs->time_scale);
+    return true;
+  case SDLK_MINUS:
+    gs->time_scale = fmaxf(gs->time_scale - (gs->time_scale <= 1.0f ? 0.1f : 0.5f), 0.0f);
+    SDL_Log("Time scale: %lf", gs->time_scale);
+    return true;
+  case SDLK_0:
+    gs->time_scale = 1.0f;
+    SDL_Log("Time scale: %lf (Default)", gs->time_scale);
+    return true;
+  case SDLK_p:
+    gs->paused = !gs->paused;
+    return true;
+  case SDLK_LEFT:
+    gs->leaderboard_page = MAX(gs->leaderboard_page - 1, 0);
+    return true;
+  case SDLK_RIGHT:
+    gs->leaderboard_page = MIN(gs->leaderboard_page + 1, gs->leaderboard->size / PAGE_SIZE);
+    return true;
+  }
+
+  return false;
+}
+
+// Single producer, single consumer: only game_event() moves key_head, only read_keys() moves key_tail
+void push_key(SDL_Keycode key)
+{
+  uint32_t head = SDL_AtomicGet(&gs->key_head);
+  if (head - (uint32_t)SDL_AtomicGet(&gs->key_tail) == KEY_QUEUE_SIZE)
+  {
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Key queue full, dropped %d", key);
+    return;
+  }
+
+  gs->keys[head % KEY_QUEUE_SIZE] = key;
+  SDL_AtomicSet(&gs->key_head, head + 1);
+}
+
+// Applies the keys pressed since the last call on the thread that owns the simulation, returns how many
+uint32_t read_keys(void)
+{
+  uint32_t tail = SDL_AtomicGet(&gs->key_tail);
+  uint32_t head = SDL_AtomicGet(&gs->key_head);
+  uint32_t count = head - tail;
+
+  for (; tail != head; tail++)
+  {
+    SDL_Keycode key = gs->keys[tail % KEY_QUEUE_SIZE];
+    SDL_AtomicSet(&gs->key_tail, tail + 1);
+
+    if (gs->level != 4 && handle_control_key(key))
+      continue;
+
+    // Everything else changes the simulation, so a replay supplies it instead
+    if (REPLAYING)
+      continue;
+
+    if (gs->replay.mode == REPLAY_RECORD)
+      Replay_Key(&gs->replay, key);
+    handle_key(key);
+  }
+
+  return count;
+}
+
+// Copies what game_render() reads into the back slot and hands it to the renderer
+void publish_snapshot(uint64_t now)
+{
+  Snapshot *snapshot = &gs->snapshot[gs->snapshots.back];
+
+  snapshot->tick = gs->tick;
+  snapshot->time = now;
+  snapshot->accumulator = gs->accumulator;
+  snapshot->time_scale = gs->paused ? 0 : gs->time_scale;
+  snapshot->level = gs->level;
+  snapshot->lives = gs->lives;
+  snapshot->score = gs->score;
+  snapshot->play_time = gs->play_time;
+  snapshot->grounded = can_jump();
+  snapshot->player = gs->player;
+  snapshot->woman = gs->woman;
+  snapshot->enemy = gs->enemy;
+  snapshot->level_size = gs->level_size;
+
+  if (snapshot->level_version != gs->level_version)
+  {
+    COPY_VECTOR(Entity, snapshot->platforms, gs->platforms);
+    COPY_VECTOR(Entity, snapshot->ladders, gs->ladders);
+    snapshot->level_version = gs->level_version;
+  }
+  if (snapshot->collectibles_version != gs->collectibles_version)
+  {
+    COPY_VECTOR(Entity, snapshot->collectibles, gs->collectibles);
+    snapshot->collectibles_version = gs->collectibles_version;
+  }
+  COPY_VECTOR(FloatingText, snapshot->floating_texts, gs->floating_texts);
+  COPY_VECTOR(DebugLine, snapshot->debug_lines, gs->debug_lines);
+  DebugLine_vector_clear(gs->debug_lines);
+
+  BarrelStore *barrels = &gs->barrels;
+  if (snapshot->barrels->capacity < barrels->size)
+    Entity_vector_reserve(snapshot->barrels, MAX(barrels->size, snapshot->barrels->capacity * 2));
+  snapshot->barrels->size = barrels->size;
+  for (size_t i = 0; i < barrels->size; i++)
+    snapshot->barrels->data[i] = (Barrel){.pos = {barrels->x[i], barrels->y[i]}, .size = {BARREL_SIZE, BARREL_SIZE}, .vel = {barrels->dir[i], 0}, .prev = {barrels->px[i], barrels->py[i]}};
+
+  for (uint8_t i = 0; i < SPRITE_COUNT; i++)
+    snapshot->frames[i] = ((Sprite *)&gs->sprites)[i].frame;
+
+  size_t offset = gs->leaderboard_page * PAGE_SIZE;
+  snapshot->leaderboard_page = gs->leaderboard_page;
+  snapshot->leaderboard_version = gs->leaderboard_version;
+  snapshot->leaderboard_size = gs->leaderboard->size;
+  snapshot->page_size = gs->leaderboard->size > offset ? MIN(PAGE_SIZE, gs->leaderboard->size - offset) : 0;
+  if (snapshot->page_size > 0)
+    memcpy(snapshot->page, gs->leaderboard->data + offset, sizeof(Leaderboard) * snapshot->page_size);
+
+  snapshot->name[0] = '\0';
+  if (gs->level == 4)
+    memcpy(snapshot->name, Leaderboard_vector_back(gs->leaderboard)->name, sizeof(snapshot->name));
+
+  TripleBuffer_Publish(&gs->snapshots);
+}
+
+void acquire_snapshot(void)
+{
+  TripleBuffer_Acquire(&gs->snapshots);
+  ss = &gs->snapshot[gs->snapshots.front];
+}
+
+// Runs the ticks that are due by now and publishes the result if anything changed, returns the number of ticks
+uint8_t simulate(uint64_t now)
+{
+  double elapsed = (now - gs->sim_last) / (double)SDL_GetPerformanceFrequency();
+  gs->sim_last = now;
+
+  uint32_t keys = read_keys();
+
+  gs->accumulator += elapsed * gs->time_scale * !gs->paused;
+  gs->delta = TICK_DELTA;
+
+  uint8_t steps = 0;
+  for (; gs->accumulator >= TICK_DELTA && steps < TICK_MAX_STEPS; steps++)
+  {
+    ZONE(ZONE_TICK, game_tick());
+    gs->accumulator -= TICK_DELTA;
+  }
+
+  // Drop the backlog instead of spiralling when the simulation can't keep up
+  if (steps == TICK_MAX_STEPS)
+    gs->accumulator = fmod(gs->accumulator, TICK_DELTA);
+
+  if (steps > 0 || keys > 0)
+    publish_snapshot(now);
+
+  return steps;
+}
+
+int simulation_thread(void *data)
+{
+  if (gs->trace.events != NULL)
+    Trace_NameThread(&gs->trace, "simulation");
+
+  while (SDL_AtomicGet(&gs->sim_running))
+  {
+    // Nothing was due, sleep instead of spinning until the next tick
+    if (simulate(SDL_GetPerformanceCounter()) == 0)
+      SDL_Delay(1);
+  }
+
+  return 0;
+}
+
+void start_simulation(void)
+{
+  gs->sim_last = SDL_GetPerformanceCounter();
+  SDL_AtomicSet(&gs->sim_running, 1);
+
+  gs->sim_thread = SDL_CreateThread(simulation_thread, "simulation", NULL);
+  assert(gs->sim_thread != NULL);
+}
+
+// Joins the simulation thread, it runs code from this library so it must be stopped before a reload. Returns whether it was running.
+bool stop_simulation(void)
+{
+  if (gs->sim_thread == NULL)
+    return false;
+
+  SDL_AtomicSet(&gs->sim_running, 0);
+  SDL_WaitThread(gs->sim_thread, NULL);
+  gs->sim_thread = NULL;
+
+  return true;
+}
+
 GameState *game_pre_reload(void)
 {
   SDL_Log("Pre reload");
 
-  TTF_CloseFont(gs->font);
+  if (PROFILING)
+    gs->reload_start = SDL_GetPerformanceCounter();
 
-  for (uint8_t i = 0; i < sizeof(gs->sprites) / sizeof(Sprite); i++)
-    if (((Sprite *)&gs->sprites)[i].texture != NULL)
-      SDL_DestroyTexture(((Sprite *)&gs->sprites)[i].texture);
+  gs->sim_resume = stop_simulation();
+
+  // The font and the sprite atlas stay loaded, chunks and widgets are baked by code that may change
+  free_chunks();
+  free_widgets();
+
+  unhook_allocations();
 
   return gs;
 }
 
+// Maps the pack again after a new one was built, what was read from the old one is read again when next needed
+void reload_pack(void)
+{
+  // The font reads from its file as it goes, so it is closed before the mapping goes away
+  if (gs->font != NULL)
+  {
+    GlyphAtlas_Free(&gs->glyphs);
+    TTF_CloseFont(gs->font);
+    gs->font = NULL;
+  }
+
+  Pack_Close(&gs->pack);
+  if (!Pack_Open(&gs->pack, ASSET_PACK))
+    SDL_Log("No asset pack at %s, reading assets/", ASSET_PACK);
+  gs->loose_asset_count = 0;
+
+  for (uint8_t i = 0; i < LEVEL_COUNT; i++)
+    gs->level_templates[i].loaded = false;
+  for (size_t i = 0; i < SPRITE_COUNT; i++)
+    gs->sprite_mtimes[i] = -1;
+}
+
 void game_post_reload(GameState *pgs)
 {
   gs = pgs;
 
-  gs->font = TTF_OpenFont("assets/slkscr.ttf", GRID_SIZE / 2);
-  assert(gs->font != NULL);
+  hook_allocations();
+
+  // Rebuilding with nobuild also rebuilds the pack, so edited assets show up on F5
+  if (Pack_Changed(&gs->pack, ASSET_PACK))
+    reload_pack();
 
-#define X(n, f, d)                          \
-  gs->sprites.n.texture = load_texture(#n); \
-  gs->sprites.n.frames = f;                 \
+  if (!HEADLESS)
+    load_font();
+
+#define X(n, f, d, w)      \
+  gs->sprites.n.frames = f; \
   gs->sprites.n.duration = d;
   SPRITES
 #undef X
 
+  if (!HEADLESS)
+  {
+    load_sprite_atlas();
+    map_sprite_frames();
+  }
+
   reset_animations();
 
+  ss = &gs->snapshot[gs->snapshots.front];
+  if (gs->sim_resume)
+    start_simulation();
+
+  if (PROFILING && gs->reload_start != 0)
+    zone_add(ZONE_RELOAD, gs->reload_start);
+
   SDL_Log("Post reload");
 }
 
-void game_init(SDL_Window *window, SDL_Renderer *renderer, SDL_Event *event)
+void set_pacing(PacingMode mode)
+{
+  double rate = 0;
+  if (mode == PACING_VSYNC)
+  {
+    SDL_DisplayMode display;
+    rate = SDL_GetWindowDisplayMode(gs->window, &display) == 0 && display.refresh_rate > 0 ? display.refresh_rate : 60;
+  }
+  else if (mode == PACING_LIMIT)
+    rate = FRAME_RATE;
+
+  if (SDL_RenderSetVSync(gs->renderer, mode == PACING_VSYNC) != 0)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Could not %s vsync: %s", mode == PACING_VSYNC ? "enable" : "disable", SDL_GetError());
+
+  Pacer_SetMode(&gs->pacer, mode, rate);
+  SDL_Log("Pacing %s", Pacer_ModeName(mode));
+}
+
+void game_init(SDL_Window *window, SDL_Renderer *renderer, GameOptions *options)
 {
   if (gs != NULL)
     free(gs);
@@ -791,138 +2293,292 @@ void game_init(SDL_Window *window, SDL_Renderer *renderer, SDL_Event *event)
   assert(gs != NULL);
   memset(gs, 0, sizeof(*gs));
 
-  gs->keyboard = SDL_GetKeyboardState(NULL);
+  gs->options = *options;
+  if (options->trace != NULL)
+  {
+    Trace_Init(&gs->trace);
+    Trace_NameThread(&gs->trace, "main");
+  }
+  if (!Pack_Open(&gs->pack, ASSET_PACK))
+    SDL_Log("No asset pack at %s, reading assets/", ASSET_PACK);
+  gs->keyboard = HEADLESS ? gs->synthetic_keyboard : SDL_GetKeyboardState(NULL);
+  gs->rng = options->seed != 0 ? options->seed : 0x9e3779b9;
+
+  if (options->replay != NULL && Replay_Play(&gs->replay, options->replay))
+  {
+    gs->rng = gs->replay.seed;
+    if (HEADLESS && options->ticks == 0)
+      options->ticks = gs->replay.ticks;
+  }
   gs->renderer = renderer;
   gs->window = window;
-  gs->event = event;
   gs->last_frame = SDL_GetPerformanceCounter();
   gs->time_scale = 1.0f;
+  Arena_Init(&gs->frame_arena, FRAME_ARENA_SIZE);
+  init_barrels(&gs->barrels);
   gs->platforms = Entity_vector_new();
   gs->collectibles = Entity_vector_new();
   gs->ladders = Entity_vector_new();
-  gs->barrels = Entity_vector_new();
   gs->floating_texts = FloatingText_vector_new();
+  gs->debug_lines = DebugLine_vector_new();
+  RenderQueue_Init(&gs->render);
   gs->leaderboard = Leaderboard_vector_new();
 
+  TripleBuffer_Init(&gs->snapshots);
+  for (uint8_t i = 0; i < SNAPSHOT_COUNT; i++)
+  {
+    Snapshot *snapshot = &gs->snapshot[i];
+    snapshot->platforms = Entity_vector_new();
+    snapshot->ladders = Entity_vector_new();
+    snapshot->collectibles = Entity_vector_new();
+    snapshot->barrels = Entity_vector_new();
+    snapshot->floating_texts = FloatingText_vector_new();
+    snapshot->debug_lines = DebugLine_vector_new();
+  }
+
   load_level(0);
 
   game_post_reload(gs);
+
+  uint8_t level = REPLAYING ? gs->replay.level : HEADLESS ? 1 : 0;
+  if (level > 0)
+    new_game();
+  if (level > 1)
+    load_level(level);
+
+  if (options->record != NULL && !REPLAYING)
+    Replay_Record(&gs->replay, options->record, gs->level, HEADLESS ? REPLAY_AUTO_RESTART : 0, gs->rng);
+
+  gs->sim_last = gs->last_frame;
+  publish_snapshot(gs->sim_last);
+  acquire_snapshot();
+
+  if (!HEADLESS)
+    set_pacing(options->pacing);
+
+  if (!HEADLESS && !options->single_thread)
+    start_simulation();
+}
+
+uint32_t next_random(void)
+{
+  gs->rng ^= gs->rng << 13;
+  gs->rng ^= gs->rng >> 17;
+  gs->rng ^= gs->rng << 5;
+  return gs->rng;
+}
+
+// Stand-in for a player in headless runs: random key combinations held for 0.1 to 0.5 seconds
+void synthesize_input(void)
+{
+  if (gs->input_hold > 0)
+  {
+    gs->input_hold--;
+    return;
+  }
+
+  uint32_t r = next_random();
+  gs->input_hold = TICK_RATE / 10 + r % (TICK_RATE * 2 / 5);
+
+  uint8_t *keys = gs->synthetic_keyboard;
+  keys[SDL_SCANCODE_A] = (r >> 8) % 3 == 1;
+  keys[SDL_SCANCODE_D] = (r >> 8) % 3 == 2;
+  keys[SDL_SCANCODE_W] = (r >> 12) & 1;
+  keys[SDL_SCANCODE_S] = 0;
+  keys[SDL_SCANCODE_SPACE] = ((r >> 13) & 3) == 0;
+}
+
+// INPUT_* bits of the keyboard as it is right now
+uint8_t sample_input(void)
+{
+  uint8_t input = 0;
+#define X(name, scancode) input |= (gs->keyboard[scancode] != 0) << INPUT_##name;
+  INPUTS
+#undef X
+  return input;
+}
+
+void headless_update(void)
+{
+  gs->delta = TICK_DELTA;
+
+  if (!REPLAYING)
+    synthesize_input();
+  SDL_AtomicSet(&gs->live_input, sample_input());
+  read_keys();
+  ZONE(ZONE_TICK, game_tick());
+
+  uint64_t now = SDL_GetPerformanceCounter();
+  uint64_t frequency = SDL_GetPerformanceFrequency();
+  if (now - gs->last_frame >= frequency)
+  {
+    SDL_Log("HEADLESS: %.0f ticks/s (tick %llu, level %d, score %d)",
+            (gs->tick - gs->fps_tick) * (double)frequency / (now - gs->last_frame), gs->tick, gs->level, gs->score);
+
+    gs->last_frame = now;
+    gs->fps_tick = gs->tick;
+  }
 }
 
 void game_update(void)
 {
+  Arena_Reset(&gs->frame_arena);
+  gs->frame_allocs = SDL_AtomicSet(&gs->allocs, 0);
+  gs->frame_draw_calls = gs->draw_calls;
+  gs->draw_calls = 0;
+  gs->second_allocs += gs->frame_allocs;
+
+  if (HEADLESS)
+    return headless_update();
+
   int mouseX, mouseY;
   gs->mouse.buttons = SDL_GetMouseState(&mouseX, &mouseY);
   gs->mouse.pos.x = mouseX;
   gs->mouse.pos.y = mouseY;
 
   uint64_t now = SDL_GetPerformanceCounter();
-  gs->delta_unscaled = (now - gs->last_frame) / (double)SDL_GetPerformanceFrequency();
-  gs->delta = gs->delta_unscaled * gs->time_scale * !gs->paused;
+  uint64_t frequency = SDL_GetPerformanceFrequency();
+  gs->delta_unscaled = (now - gs->last_frame) / (double)frequency;
   gs->last_frame = now;
+  Pacer_Frame(&gs->pacer, gs->delta_unscaled);
+  record_zones();
 
-  update_sprites();
-  update_menu();
+  SDL_AtomicSet(&gs->live_input, sample_input());
 
-  if (!REAL_LEVEL)
-    update_physic(&gs->woman);
+  // With a simulation thread the frame only renders whatever snapshot it published last
+  if (gs->sim_thread == NULL)
+    simulate(now);
 
-  update_collectibles();
-  update_barrels();
-  update_enemy();
-  update_player();
+  acquire_snapshot();
 
-  game_render();
+  // Interpolate from the snapshot's ticks by the time that passed since it was taken
+  double since = now > ss->time ? (now - ss->time) / (double)frequency * ss->time_scale : 0;
+  gs->alpha = fmin((ss->accumulator + since) / TICK_DELTA, 1);
 
-  if (REAL_LEVEL && gs->lives == 0)
-    load_level(4);
+  ZONE(ZONE_RENDER, game_render());
 
   gs->fps_timer += gs->delta_unscaled;
   if (gs->fps_timer >= 1)
   {
     gs->fps_timer = 0;
+    gs->pacing = Pacer_Report(&gs->pacer);
 
-    char title[32];
-    snprintf(title, 32, "King Donkey (%.1f fps)", 1 / gs->delta_unscaled);
+    char title[64];
+    snprintf(title, 64, "King Donkey (%.1f fps, %s, jitter %.2f ms)", gs->pacing.fps, Pacer_ModeName(gs->pacer.mode), gs->pacing.jitter);
     SDL_SetWindowTitle(gs->window, title);
-  }
 
-  if (gs->frame_limit)
-  {
-    uint64_t elapsed = SDL_GetPerformanceCounter() - now;
-    uint64_t target = SDL_GetPerformanceFrequency() / 120;
-    if (elapsed < target)
-      SDL_Delay((target - elapsed) * 1000 / SDL_GetPerformanceFrequency());
+    debug({
+      if (gs->second_allocs > 0)
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%u heap allocations in the last second", gs->second_allocs);
+    });
+    gs->second_allocs = 0;
   }
+
+  Pacer_Wait(&gs->pacer);
+
+  // Presented here rather than by the host so the zone holds the present alone, not the reloads and events between frames
+  ZONE(ZONE_PRESENT, SDL_RenderPresent(gs->renderer));
+}
+
+// Writes the trace so far, the simulation thread adds events too so it is paused meanwhile
+void write_trace(void)
+{
+  if (gs->trace.events == NULL)
+    return;
+
+  bool resume = stop_simulation();
+  Trace_Write(&gs->trace, gs->options.trace, zone_names, TRACE_ZONE_COUNT);
+  if (resume)
+    start_simulation();
 }
 
 void game_event(SDL_Event *event)
 {
   switch (event->type)
   {
+  case SDL_RENDER_TARGETS_RESET:
+    gs->static_dirty = true;
+    gs->widgets.hud.valid = gs->widgets.leaderboard.valid = false;
+    break;
   case SDL_KEYDOWN:
-    if (gs->level == 4)
-      return handle_text_input(event->key.keysym.sym);
+    if (ss->level != 4)
+    {
+      switch (event->key.keysym.sym)
+      {
+      case SDLK_F1:
+        SDL_AtomicSet(&gs->debug, !SDL_AtomicGet(&gs->debug));
+        SDL_Log("Debug mode %s", SDL_AtomicGet(&gs->debug) ? "on" : "off");
+        return;
+      case SDLK_F2:
+        set_pacing((gs->pacer.mode + 1) % PACING_COUNT);
+        return;
+      case SDLK_F3:
+        gs->profiler = !gs->profiler;
+        SDL_Log("Profiler %s", gs->profiler ? "on" : "off");
+        return;
+      case SDLK_F4:
+        write_trace();
+        return;
+      }
+    }
 
-    switch (event->key.keysym.sym)
+    // The rest is handled by the simulation before its next tick
+    push_key(event->key.keysym.sym);
+  }
+}
+
+// Called by the host with the name of a file in assets/ that was just written. Sprites and the font are swapped
+// in place, a level is reparsed and restarted when it is the one being played. The file is read from assets/
+// from then on even when the pack has it, until a rebuilt pack is mapped.
+void game_asset_changed(const char *name)
+{
+  size_t length = strlen(name);
+  bool sheet = false;
+  for (size_t i = 0; i < SPRITE_COUNT; i++)
+    sheet |= length == strlen(sprite_names[i]) + 4 && !strncmp(name, sprite_names[i], length - 4) && !strcmp(name + length - 4, ".bmp");
+  bool text = length == 9 && !strncmp(name, "level", 5) && name[5] >= '0' && name[5] < '0' + LEVEL_COUNT && !strcmp(name + 6, ".kd");
+  if (!text && !sheet && strcmp(name, "slkscr.ttf"))
+    return;
+
+  // The simulation reads levels through the loose assets too, so it is stopped while one is added
+  bool resume = stop_simulation();
+  add_loose_asset(name);
+
+  if (text)
+  {
+    uint8_t level = name[5] - '0';
+    int64_t mtime = gs->level_templates[level].mtime;
+    LevelTemplate *template = level_template(level);
+    if (template != NULL && template->mtime != mtime && level == gs->level)
+      load_level(level);
+  }
+  else if (!HEADLESS)
+  {
+    if (sheet)
     {
-    case SDLK_F1:
-      gs->debug = !gs->debug;
-      SDL_Log("Debug mode %s", gs->debug ? "on" : "off");
-      break;
-    case SDLK_F2:
-      gs->frame_limit = !gs->frame_limit;
-      SDL_Log("Frame limit %s", gs->frame_limit ? "on" : "off");
-      break;
-    case SDLK_PLUS:
-    case SDLK_EQUALS:
-      gs->time_scale = fmin(gs->time_scale + (gs->time_scale < 1.0f ? 0.1f : 0.5f), TIME_SCALE_MAX);
-      SDL_Log("Time scale: %lf", gs->time_scale);
-      break;
-    case SDLK_MINUS:
-      gs->time_scale = fmaxf(gs->time_scale - (gs->time_scale <= 1.0f ? 0.1f : 0.5f), 0.0f);
-      SDL_Log("Time scale: %lf", gs->time_scale);
-      break;
-    case SDLK_0:
-      gs->time_scale = 1.0f;
-      SDL_Log("Time scale: %lf (Default)", gs->time_scale);
-      break;
-    case SDLK_LEFTBRACKET:
-      gs->score -= 100;
-      break;
-    case SDLK_RIGHTBRACKET:
-      gs->score += 100;
-      break;
-    case SDLK_BACKSLASH:
-      gs->lives = 3;
-      break;
-    case SDLK_1:
-    case SDLK_2:
-    case SDLK_3:
-    case SDLK_4:
-      load_level(event->key.keysym.sym - SDLK_0);
-      break;
-    case SDLK_n:
-      new_game();
-      break;
-    case SDLK_m:
-      load_level(0);
-      break;
-    case SDLK_r:
-      load_level(gs->level);
-      break;
-    case SDLK_p:
-      gs->paused = !gs->paused;
-      break;
-    case SDLK_f:
-      show_floating_text("Floating text", gs->player.pos, 2);
-      break;
-    case SDLK_LEFT:
-      gs->leaderboard_page = MAX(gs->leaderboard_page - 1, 0);
-      break;
-    case SDLK_RIGHT:
-      gs->leaderboard_page = MIN(gs->leaderboard_page + 1, gs->leaderboard->size / PAGE_SIZE);
-      break;
+      load_sprite_atlas();
+      map_sprite_frames();
     }
+    else
+      load_font();
+
+    // Chunks and widgets hold copies of the old sprites and glyphs
+    gs->static_dirty = true;
+    gs->widgets.hud.valid = gs->widgets.leaderboard.valid = false;
   }
+
+  if (resume)
+    start_simulation();
+}
+
+void game_quit(void)
+{
+  stop_simulation();
+  write_trace();
+  Trace_Free(&gs->trace);
+  Pack_Close(&gs->pack);
+
+  if (gs->replay.mode != REPLAY_OFF)
+    log_replay_state("quit");
+  Replay_Close(&gs->replay);
 }
@@ -3,6 +3,20 @@
 #include <SDL2/SDL_ttf.h>
 #include "vector.h"
 #include "vec2.h"
+#include "arena.h"
+#include "replay.h"
+#include "font.h"
+#include "render.h"
+#include "triplebuffer.h"
+#include "pacer.h"
+#include "profile.h"
+#include "trace.h"
+#include "pack.h"
+#include "level.h"
+
+#if VEC2_PRECISION == VEC2_FIXED
+#error "game.c does arithmetic on Vec2 fields directly, build it with VEC2_DOUBLE or VEC2_FLOAT"
+#endif
 
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
@@ -11,38 +25,130 @@
 #define SCREEN_WIDTH (GRID_SIZE * 32)
 #define SCREEN_HEIGHT (GRID_SIZE * 24)
 #define TIME_SCALE_MAX 10
+#define TICK_RATE 120
+#define TICK_DELTA (1.0 / TICK_RATE)
+#define FRAME_RATE 120 // frames per second with PACING_LIMIT
+#define TICK_MAX_STEPS 32
+#define FRAME_ARENA_SIZE (64 * 1024)
+#define ASSET_PACK "build/assets.pak" // built by ./nobuild pack, assets/ is read directly without it
 #define PAGE_SIZE 10
 #define NAME_LENGTH 16
+#define FLOATING_TEXT_LENGTH 16
+#define KEY_QUEUE_SIZE 64
+#define CHUNK_WIDTH SCREEN_WIDTH // static geometry is baked per chunk, a level that fits the screen is a single one
+#define CHUNK_HEIGHT SCREEN_HEIGHT
+#define CHUNK_MARGIN 1 // chunks around the view that stay baked once seen
+#define CHUNK_POOL_SIZE 16
+#define SNAPSHOT_COUNT 3
+#define ZONE_QUEUE_SIZE 64 // ticks of simulation zone timings waiting for the renderer
+
+#ifndef PROFILING
+#define PROFILING 1 // time the zones below, 0 compiles the timing out
+#endif
 
 #define GRAVITY 38
 #define PLAYER_SPEED 12
 #define PLAYER_JUMP 14
 #define ENEMY_JUMP 13
 #define BARREL_SPEED 4
+#define BARREL_SIZE GRID_SIZE
+#define BARREL_CAPACITY 4096
 
 #define COLLECTIBLE_SCORE 100
 #define BARREL_SCORE 150
 #define LEVEL_SCORE 1000
+#define LEVEL_COUNT 6 // the leaderboard, three levels, the name entry and LEVEL_WIDE
+#define LEVEL_WIDE 5  // three screens wide to try the camera and chunk streaming, only loaded with the 5 key
 
 #define ENEMY_THROW_COOLDOWN 3.5
 #define ENEMY_JUMP_COOLDOWN ENEMY_THROW_COOLDOWN
 
 #define SPRITE_SIZE 30
-#define SPRITES          \
-  X(player_idle, 2, 150) \
-  X(player_run, 2, 150)  \
-  X(player_jump, 2, 150) \
-  X(player_fall, 2, 150) \
-  X(enemy_idle, 1, 150)  \
-  X(woman, 7, 150)       \
-  X(barrel, 4, 200)      \
-  X(platform, 4, 1)      \
-  X(collectible, 1, 1)   \
-  X(ladder, 4, 1)        \
-  X(heart, 2, 1)
-
-#define debug(...) \
-  if (gs->debug)   \
+#define SPRITE_MAX_FRAMES 8
+#define SPRITE_ATLAS_WIDTH 512
+// name, frames, frame duration in ms, frame width in SPRITE_SIZE units
+#define SPRITES             \
+  X(player_idle, 2, 150, 1) \
+  X(player_run, 2, 150, 1)  \
+  X(player_jump, 2, 150, 1) \
+  X(player_fall, 2, 150, 1) \
+  X(enemy_idle, 1, 150, 3)  \
+  X(woman, 7, 150, 2)       \
+  X(barrel, 4, 200, 1)      \
+  X(platform, 4, 1, 1)      \
+  X(collectible, 1, 1, 1)   \
+  X(ladder, 4, 1, 2)        \
+  X(heart, 2, 1, 1)
+
+enum SpriteId
+{
+#define X(n, f, d, w) SPRITE_##n,
+  SPRITES
+#undef X
+  SPRITE_COUNT
+};
+
+// Everything update_player() reads, sampled once per tick into GameState.input
+#define INPUTS                \
+  X(LEFT, SDL_SCANCODE_A)     \
+  X(RIGHT, SDL_SCANCODE_D)    \
+  X(UP, SDL_SCANCODE_W)       \
+  X(DOWN, SDL_SCANCODE_S)     \
+  X(JUMP, SDL_SCANCODE_SPACE)
+
+enum Input
+{
+#define X(name, scancode) INPUT_##name,
+  INPUTS
+#undef X
+};
+
+// Timed parts of a tick, sampled per tick on the thread that runs the simulation
+#define SIM_ZONES                               \
+  X(UPDATE_SPRITES, "update_sprites")           \
+  X(UPDATE_COLLECTIBLES, "update_collectibles") \
+  X(UPDATE_BARRELS, "update_barrels")           \
+  X(UPDATE_ENEMY, "update_enemy")               \
+  X(UPDATE_PLAYER, "update_player")
+
+// Timed parts of a frame, sampled per frame on the main thread
+#define RENDER_ZONES                                \
+  X(RENDER_CHUNKS, "render_chunks")                 \
+  X(RENDER_COLLECTIBLES, "render_collectibles")     \
+  X(RENDER_BARRELS, "render_barrels")               \
+  X(RENDER_UI, "render_ui")                         \
+  X(RENDER_WOMAN, "render_woman")                   \
+  X(RENDER_ENEMY, "render_enemy")                   \
+  X(RENDER_PLAYER, "render_player")                 \
+  X(RENDER_FLOATING_TEXTS, "render_floating_texts") \
+  X(RENDER_DEBUG, "render_debug")                   \
+  X(SUBMIT, "submit")                               \
+  X(PRESENT, "present")
+
+// Only traced, they run too rarely for percentiles or contain the zones above
+#define TRACE_ZONES                       \
+  X(TICK, "game_tick")                    \
+  X(RENDER, "game_render")                \
+  X(LOAD_LEVEL, "load_level")             \
+  X(LOAD_LEADERBOARD, "load_leaderboard") \
+  X(RELOAD, "hot reload")
+
+enum Zone
+{
+#define X(name, label) ZONE_##name,
+  SIM_ZONES
+  RENDER_ZONES
+  TRACE_ZONES
+#undef X
+  TRACE_ZONE_COUNT,
+#define X(name, label) +1
+  SIM_ZONE_COUNT = 0 SIM_ZONES, // the simulation zones come first
+  ZONE_COUNT = 0 SIM_ZONES RENDER_ZONES,
+#undef X
+};
+
+#define debug(...)               \
+  if (SDL_AtomicGet(&gs->debug)) \
   __VA_ARGS__
 
 #define dprintf(...) debug(printf(__VA_ARGS__))
@@ -58,19 +164,37 @@ static const uint32_t Colors[] = {
 
 typedef struct Sprite
 {
-  SDL_Texture *texture;
+  SDL_FRect uv[SPRITE_MAX_FRAMES]; // frames in the sprite atlas, in texture coordinates
   uint8_t frames;
   uint8_t frame;
   double duration;
   double elapsed;
 } Sprite;
 
+#define WIDGET_KEY_SIZE 4
+
+// A piece of UI drawn into its own texture, redrawn only when the values it shows change
+typedef struct Widget
+{
+  SDL_Texture *texture;
+  SDL_Rect rect;
+  uint32_t key[WIDGET_KEY_SIZE]; // values the texture was drawn with
+  bool valid;
+} Widget;
+
+typedef struct BarrelHandle
+{
+  uint16_t slot;
+  uint16_t generation; // 0 is never a live generation
+} BarrelHandle;
+
 typedef struct FloatingText
 {
   Vec2 pos;
+  BarrelHandle barrel; // followed while it is alive
   double duration;
   double elapsed;
-  SDL_Texture *texture;
+  char text[FLOATING_TEXT_LENGTH];
 } FloatingText;
 
 typedef struct Leaderboard
@@ -79,29 +203,182 @@ typedef struct Leaderboard
   uint32_t score;
 } Leaderboard;
 
-typedef struct Entity
+// Line segment drawn by the simulation in debug mode, rendered from the next snapshot
+typedef struct DebugLine
 {
-  Vec2 pos;
-  Vec2 size;
-  Vec2 vel;
-} Entity;
-typedef struct Entity Player;
-typedef struct Entity Woman;
-typedef struct Entity Enemy;
-typedef struct Entity Platform;
-typedef struct Entity Collectible;
-typedef struct Entity Ladder;
-typedef struct Entity Barrel;
-
-VECTOR_DECL(Entity)
+  SDL_FPoint from;
+  SDL_FPoint to;
+  SDL_Color color;
+} DebugLine;
+
+typedef struct GameOptions
+{
+  bool headless; // no window or renderer, synthetic input, one tick per game_update()
+  bool single_thread; // simulate on the main thread between frames instead of on its own thread
+  PacingMode pacing;
+  uint64_t ticks; // headless: ticks to simulate, 0 runs until quit or the end of the replay
+  uint32_t seed;
+  const char *record; // replay file to write
+  const char *replay; // replay file to play back instead of live input
+  const char *trace; // trace event JSON of the zones, written on quit and F4
+} GameOptions;
+
 VECTOR_DECL(FloatingText)
 VECTOR_DECL(Leaderboard)
+VECTOR_DECL(DebugLine)
+
+// Everything game_render() reads from the simulation, copied out after each batch of ticks.
+// The renderer only ever sees whole snapshots, so it never races the simulation thread.
+typedef struct Snapshot
+{
+  uint64_t tick;
+  uint64_t time;          // performance counter when it was published
+  double accumulator;     // simulation time not yet ticked at that point
+  double time_scale;      // 0 while paused
+  uint32_t level_version; // platforms and ladders are only copied when it changes
+  uint32_t collectibles_version;
+  SDL_Point level_size;
+  uint8_t level;
+  uint8_t lives;
+  uint32_t score;
+  double play_time;
+  bool grounded; // the player can jump
+  Player player;
+  Woman woman;
+  Enemy enemy;
+  Entity_vector *platforms;
+  Entity_vector *ladders;
+  Entity_vector *collectibles;
+  Entity_vector *barrels; // vel.x holds the rolling direction
+  FloatingText_vector *floating_texts;
+  DebugLine_vector *debug_lines;
+  uint8_t frames[SPRITE_COUNT];
+  uint16_t leaderboard_page;
+  uint32_t leaderboard_version;
+  uint32_t leaderboard_size;
+  uint8_t page_size;
+  Leaderboard page[PAGE_SIZE]; // entries of leaderboard_page
+  char name[NAME_LENGTH + 1];  // being entered on level 4
+} Snapshot;
+
+// Draw order of the frame, within a layer draws are grouped by texture
+typedef enum RenderLayer
+{
+  LAYER_STATIC,
+  LAYER_WORLD,
+  LAYER_UI,
+  LAYER_CHARACTERS,
+  LAYER_TEXT,
+  LAYER_DEBUG,
+} RenderLayer;
+
+#define BARREL_FIELDS \
+  X(x)                \
+  X(y)                \
+  X(vx)               \
+  X(vy)               \
+  X(px)               \
+  X(py)               \
+  X(dir)              \
+  X(scored)           \
+  X(slot)
+
+// Barrels as a fixed pool of parallel arrays so update_barrels() can run batched, vectorizable kernels.
+// Live barrels are dense in [0, size), slots give them stable generational handles.
+typedef struct BarrelStore
+{
+  vec_t *x;
+  vec_t *y;
+  vec_t *vx;
+  vec_t *vy;
+  vec_t *px;  // x at the start of the tick
+  vec_t *py;  // y at the start of the tick
+  vec_t *dir; // rolling direction, -1 or 1
+  bool *scored;
+  uint16_t *slot;       // dense index -> slot
+  uint16_t *index;      // slot -> dense index, or the next free slot
+  uint16_t *generation; // bumped every time the slot is freed
+  uint16_t free;
+  size_t size;
+  size_t capacity;
+} BarrelStore;
+
+// Static geometry bucketed by cells covering the level, cells[c]..cells[c + 1] index into items
+typedef struct SpatialGrid
+{
+  uint16_t cols;
+  uint16_t rows;
+  SDL_Point cell; // size of a cell in pixels
+  uint32_t *cells;
+  uint32_t *items;
+  size_t cell_capacity;
+  size_t capacity;
+} SpatialGrid;
+
+// One bit per GRID_SIZE tile, each row is stride words wide
+typedef struct TileMap
+{
+  uint16_t cols;
+  uint16_t rows;
+  uint16_t stride;
+  uint32_t *solid;
+  uint32_t *ladder;
+  size_t capacity; // words in each bitmap
+  bool aligned; // every platform lies on tile boundaries, so solid bits are exact
+} TileMap;
+
+// Platforms and ladders baked into one texture per CHUNK_WIDTH x CHUNK_HEIGHT chunk of the level.
+// Only chunks near the view hold a texture, the others are released back to the pool.
+typedef struct ChunkMap
+{
+  SpatialGrid platforms; // which platforms overlap each chunk
+  SpatialGrid ladders;
+  SDL_Texture **textures; // per chunk, NULL while inactive
+  size_t capacity;
+  SDL_Rect active; // range of chunks that may hold a texture
+  SDL_Texture *pool[CHUNK_POOL_SIZE];
+  uint8_t pooled;
+  uint32_t version; // level_version the chunks were built for
+} ChunkMap;
+
+// A level as parsed from its file, copied into the live vectors every time the level is entered
+typedef struct LevelTemplate
+{
+  Level level;
+  int64_t mtime; // of the text file, 0 for a level read from the pack
+  bool loaded;
+} LevelTemplate;
 
 typedef struct GameState
 {
-  bool debug;
-  bool frame_limit;
+  GameOptions options;
+  SDL_atomic_t debug; // toggled on the main thread, read by the simulation too
+  Pacer pacer;
+  PacerReport pacing; // frame times over the last second
+  bool profiler; // overlay with the zone percentiles and the frame time graph
+  ProfileRing zones[ZONE_COUNT];
+  ProfileRing frame_times;
+  float tick_zones[SIM_ZONE_COUNT]; // owned by the simulation, the tick being timed
+  float frame_zones[ZONE_COUNT];    // render zones of the frame being timed
+  float zone_queue[ZONE_QUEUE_SIZE][SIM_ZONE_COUNT]; // ticks timed by the simulation, drained by the renderer
+  SDL_atomic_t zone_head;
+  SDL_atomic_t zone_tail;
+  uint64_t reload_start;
+  Trace trace;
+  Pack pack;
+  char loose_assets[LEVEL_COUNT + SPRITE_COUNT + 1][PACK_NAME_SIZE]; // saved in assets/ since the pack was mapped, read from there
+  uint8_t loose_asset_count;
+  LevelTemplate level_templates[LEVEL_COUNT];
   const uint8_t *keyboard;
+  uint8_t synthetic_keyboard[SDL_NUM_SCANCODES];
+  uint32_t rng;
+  uint32_t input_hold;
+  uint8_t input; // INPUT_* bits for the current tick
+  SDL_atomic_t live_input; // INPUT_* bits last sampled from the keyboard
+  SDL_Keycode keys[KEY_QUEUE_SIZE]; // pressed on the main thread, handled before the next tick
+  SDL_atomic_t key_head;
+  SDL_atomic_t key_tail;
+  Replay replay;
   struct Mouse
   {
     Vec2 pos;
@@ -109,14 +386,48 @@ typedef struct GameState
   } mouse;
   SDL_Renderer *renderer;
   SDL_Window *window;
-  SDL_Event *event;
-  TTF_Font *font;
+  TTF_Font *font; // the font and the sprite atlas survive hot reloads
+  int64_t font_mtime;
+  GlyphAtlas glyphs;
+  SDL_Texture *sprite_atlas;
+  SDL_Point sprite_atlas_size;
+  SDL_Rect sprite_regions[SPRITE_COUNT]; // of each sheet in the atlas
+  int64_t sprite_mtimes[SPRITE_COUNT]; // of each sheet when it was uploaded
+  RenderQueue render;
+  RenderLayer layer; // layer the render_* functions emit into
+  RenderPass offscreen; // pass drawing into the current widget or static layer texture
+  uint32_t draw_calls; // so far this frame, including offscreen passes
+  uint32_t frame_draw_calls;
+  uint32_t render_commands;
+  ChunkMap chunks;
+  bool static_dirty; // chunk textures lost their contents
+  SDL_Point camera;  // top left of the view in level pixels
+  struct Widgets
+  {
+    Widget hud;
+    Widget leaderboard;
+  } widgets;
   bool paused;
   double time_scale;
   uint64_t last_frame;
   double delta;
   double delta_unscaled;
   double fps_timer;
+  double accumulator;
+  double alpha;
+  uint64_t tick;
+  uint64_t fps_tick;
+  SDL_Thread *sim_thread;
+  SDL_atomic_t sim_running;
+  bool sim_resume; // the thread was stopped by game_pre_reload()
+  uint64_t sim_last; // performance counter of the last simulate()
+  TripleBuffer snapshots;
+  Snapshot snapshot[SNAPSHOT_COUNT];
+  DebugLine_vector *debug_lines; // drawn by ticks since the last snapshot
+  Arena frame_arena;
+  SDL_atomic_t allocs;
+  uint32_t frame_allocs;
+  uint32_t second_allocs;
 
   Player player;
   Woman woman;
@@ -124,8 +435,11 @@ typedef struct GameState
   Entity_vector *platforms;
   Entity_vector *collectibles;
   Entity_vector *ladders;
-  Entity_vector *barrels;
+  BarrelStore barrels;
   FloatingText_vector *floating_texts;
+  SpatialGrid platform_grid;
+  SpatialGrid ladder_grid;
+  TileMap tiles;
 
   double play_time;
   uint8_t level;
@@ -134,23 +448,29 @@ typedef struct GameState
   uint64_t time;
   double enemy_jump_cooldown;
   double enemy_throw_cooldown;
+  uint32_t level_version; // bumped by load_level()
+  uint32_t collectibles_version;
+  SDL_Point level_size; // in pixels, never smaller than the screen
   Leaderboard_vector *leaderboard;
   uint16_t leaderboard_page;
+  uint32_t leaderboard_version; // bumped whenever the entries are reloaded
 
   struct Sprites
   {
-#define X(n, f, d) Sprite n;
+#define X(n, f, d, w) Sprite n;
     SPRITES
 #undef X
   } sprites;
 } GameState;
 
-#define GAME_HOTRELOAD                             \
-  X(game_init, void, SDL_Window *, SDL_Renderer *) \
-  X(game_pre_reload, GameState *, void)            \
-  X(game_post_reload, void, GameState *)           \
-  X(game_update, void, void)                       \
-  X(game_event, void, SDL_Event *)
+#define GAME_HOTRELOAD                                            \
+  X(game_init, void, SDL_Window *, SDL_Renderer *, GameOptions *) \
+  X(game_pre_reload, GameState *, void)                           \
+  X(game_post_reload, void, GameState *)                          \
+  X(game_update, void, void)                                      \
+  X(game_event, void, SDL_Event *)                                \
+  X(game_asset_changed, void, const char *)                       \
+  X(game_quit, void, void)
 
 #define X(name, ret, ...) typedef ret(name##_t)(__VA_ARGS__);
 GAME_HOTRELOAD
@@ -3,7 +3,8 @@
 #include <dlfcn.h>
 #include "hotreload.h"
 
-static const char *libplug_file_name = "libgame.so";
+// A path, dlopen() looks for a bare name in the system library directories only
+static const char *libplug_file_name = "./" GAME_LIBRARY_DIR "/" GAME_LIBRARY;
 static void *libgame = NULL;
 
 #define X(name, ...) name##_t *name = NULL;
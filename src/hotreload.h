@@ -2,6 +2,10 @@
 #include <stdbool.h>
 #include "game.h"
 
+// Run from the root of the repository, which is also where assets/ is read from
+#define GAME_LIBRARY_DIR "build"
+#define GAME_LIBRARY "libgame.so"
+
 #define X(name, ...) extern name##_t *name;
 GAME_HOTRELOAD
 #undef X
@@ -0,0 +1,117 @@
+#include "level.h"
+#include <string.h>
+
+static Vec2 scaled(double x, double y, uint16_t unit)
+{
+  return (Vec2){x * unit, y * unit};
+}
+
+// Reads the text format, a type name on its own line followed by pos(x y) and size(w h) lines in grid cells.
+// Returns 0, or the number of the first line that isn't understood.
+int Level_Parse(Level *level, FILE *file, uint16_t unit)
+{
+  Entity *entity = NULL;
+  char line[64];
+
+  for (int number = 1; fgets(line, sizeof(line), file) != NULL; number++)
+  {
+    char type[LEVEL_TYPE_LENGTH];
+    double x, y;
+
+    if (entity != NULL && sscanf(line, " pos(%lf %lf)", &x, &y) == 2)
+      entity->pos = scaled(x, y, unit);
+    else if (entity != NULL && sscanf(line, " size(%lf %lf)", &x, &y) == 2)
+      entity->size = scaled(x, y, unit);
+    else if (sscanf(line, " %15s", type) != 1)
+      continue;
+    else if (!strcmp(type, "Player"))
+      entity = &level->player;
+    else if (!strcmp(type, "Woman"))
+      entity = &level->woman;
+    else if (!strcmp(type, "Enemy"))
+      entity = &level->enemy;
+    else if (!strcmp(type, "Platform"))
+      entity = Entity_vector_push(level->platforms, &(Platform){0});
+    else if (!strcmp(type, "Ladder"))
+      entity = Entity_vector_push(level->ladders, &(Ladder){0});
+    else if (!strcmp(type, "Collectible"))
+      entity = Entity_vector_push(level->collectibles, &(Collectible){.size = scaled(1, 1, unit)});
+    else
+      return number;
+  }
+
+  return 0;
+}
+
+bool Level_Write(Level *level, FILE *file, uint16_t unit)
+{
+  LevelHeader header = {
+      .version = LEVEL_VERSION,
+      .entity_size = sizeof(Entity),
+      .unit = unit,
+      .precision = VEC2_PRECISION,
+      .platforms = level->platforms->size,
+      .ladders = level->ladders->size,
+      .collectibles = level->collectibles->size};
+  memcpy(header.magic, LEVEL_MAGIC, 4);
+
+  return fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(&level->player, sizeof(Entity), 1, file) == 1 &&
+         fwrite(&level->woman, sizeof(Entity), 1, file) == 1 &&
+         fwrite(&level->enemy, sizeof(Entity), 1, file) == 1 &&
+         fwrite(level->platforms->data, sizeof(Entity), header.platforms, file) == header.platforms &&
+         fwrite(level->ladders->data, sizeof(Entity), header.ladders, file) == header.ladders &&
+         fwrite(level->collectibles->data, sizeof(Entity), header.collectibles, file) == header.collectibles;
+}
+
+// Whether data is a complete compiled level this build can load as is
+bool Level_Valid(const void *data, size_t size, uint16_t unit)
+{
+  const LevelHeader *header = data;
+  if (size < sizeof(LevelHeader) || memcmp(header->magic, LEVEL_MAGIC, 4) || header->version != LEVEL_VERSION)
+    return false;
+  if (header->entity_size != sizeof(Entity) || header->precision != VEC2_PRECISION || header->unit != unit)
+    return false;
+
+  size_t entities = 3 + (size_t)header->platforms + header->ladders + header->collectibles;
+  return (size - sizeof(LevelHeader)) / sizeof(Entity) >= entities;
+}
+
+static void append(Entity_vector *vector, const Entity *entities, uint32_t count)
+{
+  if (count == 0)
+    return;
+
+  size_t size = vector->size;
+  Entity_vector_reserve(vector, size + count);
+  memcpy(vector->data + size, entities, sizeof(Entity) * count);
+  vector->size = size + count;
+}
+
+// Copies a compiled level that passed Level_Valid, no parsing or conversion involved
+void Level_Load(Level *level, const void *data)
+{
+  const LevelHeader *header = data;
+  const Entity *entities = (const Entity *)(header + 1);
+
+  memcpy(&level->player, &entities[0], sizeof(Entity));
+  memcpy(&level->woman, &entities[1], sizeof(Entity));
+  memcpy(&level->enemy, &entities[2], sizeof(Entity));
+  entities += 3;
+
+  append(level->platforms, entities, header->platforms);
+  append(level->ladders, entities + header->platforms, header->ladders);
+  append(level->collectibles, entities + header->platforms + header->ladders, header->collectibles);
+}
+
+// Copies the characters and appends the entities of a level that was read earlier
+void Level_Copy(Level *level, const Level *source)
+{
+  level->player = source->player;
+  level->woman = source->woman;
+  level->enemy = source->enemy;
+
+  append(level->platforms, source->platforms->data, source->platforms->size);
+  append(level->ladders, source->ladders->data, source->ladders->size);
+  append(level->collectibles, source->collectibles->data, source->collectibles->size);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+#include "entity.h"
+
+#define LEVEL_MAGIC "KDLV"
+#define LEVEL_VERSION 1
+#define LEVEL_TYPE_LENGTH 16
+
+// Compiled levels are the header, the player, woman and enemy, then the platforms, ladders and collectibles,
+// all as Entity structs in pixels. They only load into builds with the same Entity layout and grid size.
+typedef struct LevelHeader
+{
+  char magic[4];
+  uint16_t version;
+  uint16_t entity_size; // sizeof(Entity), which VEC2_PRECISION changes
+  uint16_t unit;        // pixels per grid cell in the text format
+  uint8_t precision;    // VEC2_PRECISION
+  uint8_t reserved;
+  uint32_t platforms;
+  uint32_t ladders;
+  uint32_t collectibles;
+} LevelHeader;
+
+// Where a level is read into, entities are appended to the vectors.
+// The characters only get their position from the level, what else they had is kept.
+typedef struct Level
+{
+  Entity player;
+  Entity woman;
+  Entity enemy;
+  Entity_vector *platforms;
+  Entity_vector *ladders;
+  Entity_vector *collectibles;
+} Level;
+
+int Level_Parse(Level *level, FILE *file, uint16_t unit);
+bool Level_Write(Level *level, FILE *file, uint16_t unit);
+bool Level_Valid(const void *data, size_t size, uint16_t unit);
+void Level_Load(Level *level, const void *data);
+void Level_Copy(Level *level, const Level *source);
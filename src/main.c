@@ -3,24 +3,127 @@
 #include <stdbool.h>
 #include "hotreload.h"
 #include "game.h"
+#include "watch.h"
 
-int main(void)
+bool parse_options(int argc, char **argv, GameOptions *options)
 {
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--headless"))
+    {
+      options->headless = true;
+      if (i + 1 < argc && isdigit(argv[i + 1][0]))
+        options->ticks = strtoull(argv[++i], NULL, 10);
+    }
+    else if (!strcmp(argv[i], "--single-thread"))
+      options->single_thread = true;
+    else if (!strcmp(argv[i], "--pacing") && i + 1 < argc && Pacer_ParseMode(argv[i + 1], &options->pacing))
+      i++;
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+      options->seed = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+      options->record = argv[++i];
+    else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+      options->replay = argv[++i];
+    else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+      options->trace = argv[++i];
+    else
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Usage: %s [--headless [ticks]] [--single-thread] [--pacing vsync|limit|uncapped] [--seed n] [--record file | --replay file] [--trace file]", argv[0]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Swaps in the library as it is on disk now, keeping the game state
+bool reload_game(void)
+{
+  GameState *state = game_pre_reload();
+  if (!game_hotreload())
+    return false;
+  game_post_reload(state);
+  return true;
+}
+
+// Simulation only, as fast as the CPU allows
+int run_headless(GameOptions *options)
+{
+  SDL_Init(SDL_INIT_EVENTS);
+
+  if (!game_hotreload())
+    return 1;
+
+  game_init(NULL, NULL, options);
+
+  uint64_t start = SDL_GetPerformanceCounter();
+  uint64_t ticks = 0;
+  bool quit = false;
+
+  while (!quit && (options->ticks == 0 || ticks < options->ticks))
+  {
+    game_update();
+    ticks++;
+
+    SDL_Event event;
+    if (ticks % 1024 == 0 && SDL_PollEvent(&event) && event.type == SDL_QUIT)
+      quit = true;
+  }
+
+  double elapsed = (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+  game_quit();
+  SDL_Log("HEADLESS: %llu ticks in %.3fs (%.0f ticks/s, %.1fx real time)",
+          ticks, elapsed, ticks / elapsed, ticks / elapsed / TICK_RATE);
+
+  SDL_Quit();
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  GameOptions options = {.seed = 1};
+  if (!parse_options(argc, argv, &options))
+    return 1;
+
+  if (options.headless)
+    return run_headless(&options);
+
   SDL_Init(SDL_INIT_VIDEO);
   TTF_Init();
 
-  SDL_Window *window = SDL_CreateWindow("King Donkey", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_METAL);
-  SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+  // Metal only exists on Apple platforms, asking for it anywhere else fails to create the window
+#ifdef __APPLE__
+  Uint32 window_flags = SDL_WINDOW_METAL;
+#else
+  Uint32 window_flags = 0;
+#endif
+  SDL_Window *window = SDL_CreateWindow("King Donkey", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, window_flags);
+  SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE | (options.pacing == PACING_VSYNC ? SDL_RENDERER_PRESENTVSYNC : 0));
 
   bool quit = false;
 
   if (!game_hotreload())
     return 1;
 
-  game_init(window, renderer);
+  game_init(window, renderer, &options);
+
+  Watcher watcher;
+  Watcher_Init(&watcher, GAME_LIBRARY_DIR, GAME_LIBRARY, "assets", "src");
 
   while (!quit)
   {
+    if (Watcher_Poll(&watcher))
+    {
+      uint64_t start = SDL_GetPerformanceCounter();
+      if (!reload_game())
+        return 1;
+      Watcher_Reloaded(&watcher, start);
+    }
+    for (uint8_t i = 0; i < watcher.changed_count; i++)
+      game_asset_changed(watcher.changed[i]);
+
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
@@ -36,14 +139,10 @@ int main(void)
           quit = true;
           break;
         case SDLK_F5:
-        {
-          GameState *state = game_pre_reload();
-          if (!game_hotreload())
+          if (!reload_game())
             return 1;
-          game_post_reload(state);
           break;
         }
-        }
         break;
       }
       game_event(&event);
@@ -52,11 +151,13 @@ int main(void)
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
+    // Renders and presents the frame
     game_update();
-
-    SDL_RenderPresent(renderer);
   }
 
+  game_quit();
+  Watcher_Free(&watcher);
+
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
 
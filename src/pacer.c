@@ -0,0 +1,100 @@
+#include "pacer.h"
+#include <math.h>
+#include <string.h>
+
+static const char *mode_names[] = {
+#define X(name, label) label,
+    PACING_MODES
+#undef X
+};
+
+const char *Pacer_ModeName(PacingMode mode)
+{
+  return mode < PACING_COUNT ? mode_names[mode] : "?";
+}
+
+bool Pacer_ParseMode(const char *name, PacingMode *mode)
+{
+  for (int i = 0; i < PACING_COUNT; i++)
+  {
+    if (!strcmp(name, mode_names[i]))
+    {
+      *mode = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Rate in frames per second that the mode paces to, or 0 when uncapped
+void Pacer_SetMode(Pacer *pacer, PacingMode mode, double rate)
+{
+  pacer->mode = mode;
+  pacer->frequency = SDL_GetPerformanceFrequency();
+  pacer->period = rate > 0 ? pacer->frequency / rate : 0;
+  pacer->deadline = 0;
+  if (pacer->sleep_error == 0)
+    pacer->sleep_error = pacer->frequency / 1000;
+
+  // Statistics of the previous mode would blur the new one
+  Pacer_Report(pacer);
+}
+
+void Pacer_Wait(Pacer *pacer)
+{
+  if (pacer->mode != PACING_LIMIT || pacer->period == 0)
+    return;
+
+  uint64_t now = SDL_GetPerformanceCounter();
+  uint64_t millisecond = pacer->frequency / 1000;
+
+  // A frame that overran by a whole period starts a new schedule instead of rushing the next ones to catch up
+  if (pacer->deadline == 0 || now > pacer->deadline + pacer->period)
+    pacer->deadline = now;
+  pacer->deadline += pacer->period;
+
+  while (pacer->deadline > now && pacer->deadline - now > millisecond + pacer->sleep_error)
+  {
+    SDL_Delay(1);
+    uint64_t slept = SDL_GetPerformanceCounter() - now;
+    now += slept;
+
+    // Track the worst overshoot, decaying so that one bad sleep doesn't make every frame spin longer
+    uint64_t error = slept > millisecond ? slept - millisecond : 0;
+    pacer->sleep_error = SDL_max(error, pacer->sleep_error - pacer->sleep_error / 64);
+  }
+
+  while (now < pacer->deadline)
+    now = SDL_GetPerformanceCounter();
+}
+
+void Pacer_Frame(Pacer *pacer, double seconds)
+{
+  double ms = seconds * 1000;
+
+  pacer->frames++;
+  pacer->sum += ms;
+  pacer->sum_squares += ms * ms;
+  pacer->worst = SDL_max(pacer->worst, ms);
+
+  if (pacer->period > 0 && seconds * pacer->frequency > pacer->period * PACER_LATE)
+    pacer->late++;
+}
+
+// Statistics since the last report, which starts the next interval
+PacerReport Pacer_Report(Pacer *pacer)
+{
+  PacerReport report = {.frames = pacer->frames, .worst = pacer->worst, .late = pacer->late};
+
+  if (pacer->frames > 0)
+  {
+    report.mean = pacer->sum / pacer->frames;
+    report.jitter = sqrt(SDL_max(pacer->sum_squares / pacer->frames - report.mean * report.mean, 0));
+    report.fps = report.mean > 0 ? 1000 / report.mean : 0;
+  }
+
+  pacer->frames = pacer->late = 0;
+  pacer->sum = pacer->sum_squares = pacer->worst = 0;
+
+  return report;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PACER_LATE 1.5 // a frame longer than this many periods counts as late
+
+#define PACING_MODES  \
+  X(VSYNC, "vsync")   \
+  X(LIMIT, "limit")   \
+  X(UNCAPPED, "uncapped")
+
+typedef enum PacingMode
+{
+#define X(name, label) PACING_##name,
+  PACING_MODES
+#undef X
+  PACING_COUNT,
+} PacingMode;
+
+// Frame times over the last reporting interval, in milliseconds
+typedef struct PacerReport
+{
+  uint32_t frames;
+  double fps;
+  double mean;
+  double jitter; // standard deviation of the frame time
+  double worst;
+  uint32_t late;
+} PacerReport;
+
+// Paces frames to a fixed period without relying on the scheduler: PACING_LIMIT sleeps while the deadline is further
+// away than a sleep has been seen to overshoot, then spins on the performance counter for the rest.
+typedef struct Pacer
+{
+  PacingMode mode;
+  uint64_t frequency;
+  uint64_t period;      // counts per frame, the display refresh with vsync, 0 when uncapped
+  uint64_t deadline;    // end of the current frame with PACING_LIMIT
+  uint64_t sleep_error; // recent worst overshoot of SDL_Delay(1)
+  uint32_t frames;
+  double sum;
+  double sum_squares;
+  double worst;
+  uint32_t late;
+} Pacer;
+
+const char *Pacer_ModeName(PacingMode mode);
+bool Pacer_ParseMode(const char *name, PacingMode *mode);
+void Pacer_SetMode(Pacer *pacer, PacingMode mode, double rate);
+void Pacer_Wait(Pacer *pacer);
+void Pacer_Frame(Pacer *pacer, double seconds);
+PacerReport Pacer_Report(Pacer *pacer);
@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200809L // mmap and fmemopen
+#define _DARWIN_C_SOURCE        // st_mtimespec, which strict POSIX hides on macOS
+#include "pack.h"
+#include <SDL2/SDL.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool valid_pack(const uint8_t *data, size_t size)
+{
+  if (size < sizeof(PackHeader))
+    return false;
+
+  const PackHeader *header = (const PackHeader *)data;
+  if (memcmp(header->magic, PACK_MAGIC, 4) || header->version != PACK_VERSION)
+    return false;
+  if (sizeof(PackHeader) + sizeof(PackEntry) * header->count > size)
+    return false;
+
+  const PackEntry *entries = (const PackEntry *)(header + 1);
+  for (uint16_t i = 0; i < header->count; i++)
+    if (entries[i].offset > size || entries[i].size > size - entries[i].offset || entries[i].name[PACK_NAME_SIZE - 1] != '\0')
+      return false;
+
+  return true;
+}
+
+static int64_t modified(const struct stat *st)
+{
+#ifdef __APPLE__
+  return (int64_t)st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+#else
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+bool Pack_Open(Pack *pack, const char *path)
+{
+  memset(pack, 0, sizeof(*pack));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  void *data = fstat(fd, &st) == 0 && st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data != MAP_FAILED)
+    pack->mtime = modified(&st);
+
+  if (data == MAP_FAILED)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "PACK: could not map %s", path);
+    return false;
+  }
+
+  if (!valid_pack(data, st.st_size))
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "PACK: %s is not a version %d pack", path, PACK_VERSION);
+    munmap(data, st.st_size);
+    return false;
+  }
+
+  pack->data = data;
+  pack->size = st.st_size;
+  pack->entries = (const PackEntry *)((const PackHeader *)data + 1);
+  pack->count = ((const PackHeader *)data)->count;
+
+  SDL_Log("PACK: mapped %s (%u files, %zu KiB)", path, pack->count, pack->size / 1024);
+
+  return true;
+}
+
+void Pack_Close(Pack *pack)
+{
+  if (pack->data != NULL)
+    munmap((void *)pack->data, pack->size);
+  memset(pack, 0, sizeof(*pack));
+}
+
+// Whether the file at path was replaced, created or removed since the pack was opened from it.
+// The pack tool renames a finished pack into place, so a new modification time means a complete new pack.
+bool Pack_Changed(Pack *pack, const char *path)
+{
+  struct stat st;
+  return (stat(path, &st) == 0 ? modified(&st) : 0) != pack->mtime;
+}
+
+static int compare_entry(const void *name, const void *entry)
+{
+  return strncmp(name, ((const PackEntry *)entry)->name, PACK_NAME_SIZE);
+}
+
+// Contents of the named file, NULL when there is no pack or it doesn't contain the file
+const void *Pack_Find(Pack *pack, const char *name, size_t *size)
+{
+  if (pack->data == NULL)
+    return NULL;
+
+  const PackEntry *entry = bsearch(name, pack->entries, pack->count, sizeof(PackEntry), compare_entry);
+  if (entry == NULL)
+    return NULL;
+
+  *size = entry->size;
+  return pack->data + entry->offset;
+}
+
+// Read only stream over the named file for code that parses with stdio
+FILE *Pack_OpenFile(Pack *pack, const char *name)
+{
+  size_t size;
+  const void *data = Pack_Find(pack, name, &size);
+  return data != NULL && size > 0 ? fmemopen((void *)data, size, "r") : NULL;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PACK_MAGIC "KDPK"
+#define PACK_VERSION 1
+#define PACK_NAME_SIZE 24
+#define PACK_ALIGN 16 // of every file's data in the pack
+
+// Fields are in the byte order of the machine that built the pack, which then reads as a different version anywhere else
+typedef struct PackHeader
+{
+  char magic[4];
+  uint16_t version;
+  uint16_t count;
+} PackHeader;
+
+// Sorted by name, right after the header
+typedef struct PackEntry
+{
+  char name[PACK_NAME_SIZE];
+  uint32_t offset; // from the start of the pack
+  uint32_t size;
+} PackEntry;
+
+// Every asset in one file mapped into memory, lookups point straight into the mapping
+typedef struct Pack
+{
+  const uint8_t *data; // NULL when no pack is open
+  size_t size;
+  const PackEntry *entries;
+  uint16_t count;
+  int64_t mtime; // of the file when it was opened in nanoseconds, 0 when there was none
+} Pack;
+
+bool Pack_Open(Pack *pack, const char *path);
+void Pack_Close(Pack *pack);
+bool Pack_Changed(Pack *pack, const char *path);
+const void *Pack_Find(Pack *pack, const char *name, size_t *size);
+FILE *Pack_OpenFile(Pack *pack, const char *name);
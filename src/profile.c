@@ -0,0 +1,39 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+void ProfileRing_Push(ProfileRing *ring, float ms)
+{
+  ring->samples[ring->count++ % PROFILE_HISTORY] = ms;
+}
+
+// Sample pushed age samples ago, 0 when the ring doesn't reach that far back
+float ProfileRing_Get(ProfileRing *ring, uint32_t age)
+{
+  if (age >= ring->count || age >= PROFILE_HISTORY)
+    return 0;
+  return ring->samples[(ring->count - 1 - age) % PROFILE_HISTORY];
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest rank percentiles of the samples in the ring, scratch must hold PROFILE_HISTORY floats
+ProfileStats ProfileRing_Stats(ProfileRing *ring, float *scratch)
+{
+  uint32_t count = ring->count < PROFILE_HISTORY ? ring->count : PROFILE_HISTORY;
+  if (count == 0)
+    return (ProfileStats){0};
+
+  memcpy(scratch, ring->samples, sizeof(float) * count);
+  qsort(scratch, count, sizeof(float), compare_floats);
+
+  return (ProfileStats){
+      .p50 = scratch[(count - 1) * 50 / 100],
+      .p95 = scratch[(count - 1) * 95 / 100],
+      .p99 = scratch[(count - 1) * 99 / 100],
+      .max = scratch[count - 1]};
+}
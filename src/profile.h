@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+#define PROFILE_HISTORY 256 // samples kept per ring, about two seconds of frames
+
+// The last PROFILE_HISTORY samples of a timing, in milliseconds
+typedef struct ProfileRing
+{
+  float samples[PROFILE_HISTORY];
+  uint32_t count; // pushed so far, the newest sample is at (count - 1) % PROFILE_HISTORY
+} ProfileRing;
+
+typedef struct ProfileStats
+{
+  float p50;
+  float p95;
+  float p99;
+  float max;
+} ProfileStats;
+
+void ProfileRing_Push(ProfileRing *ring, float ms);
+float ProfileRing_Get(ProfileRing *ring, uint32_t age);
+ProfileStats ProfileRing_Stats(ProfileRing *ring, float *scratch);
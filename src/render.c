@@ -0,0 +1,106 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VECTOR_MALLOC SDL_malloc
+#define VECTOR_REALLOC SDL_realloc
+#define VECTOR_FREE SDL_free
+#include "render.h"
+
+VECTOR_IMPL(Vertex)
+VECTOR_IMPL(RenderCommand)
+
+static int command_comparator(const RenderCommand *a, const RenderCommand *b)
+{
+  if (a->layer != b->layer)
+    return a->layer < b->layer ? -1 : 1;
+  if (a->texture != b->texture)
+    return (uintptr_t)a->texture < (uintptr_t)b->texture ? -1 : 1;
+  return a->sequence < b->sequence ? -1 : a->sequence > b->sequence;
+}
+
+// Grows geometrically, Vertex_vector_reserve() alone would reallocate on every append
+static Vertex *append_vertices(Vertex_vector *vertices, size_t count)
+{
+  size_t first = vertices->size;
+  if (first + count > vertices->capacity)
+    Vertex_vector_reserve(vertices, SDL_max(vertices->capacity * 2, first + count));
+
+  vertices->size += count;
+  return &vertices->data[first];
+}
+
+void RenderQueue_Init(RenderQueue *queue)
+{
+  queue->commands = RenderCommand_vector_new();
+  queue->vertices = Vertex_vector_new();
+  queue->batch = Vertex_vector_new();
+  queue->pass = 0;
+  queue->sequence = 0;
+}
+
+void RenderQueue_Free(RenderQueue *queue)
+{
+  RenderCommand_vector_free(queue->commands);
+  Vertex_vector_free(queue->vertices);
+  Vertex_vector_free(queue->batch);
+}
+
+Vertex *RenderQueue_Triangles(RenderQueue *queue, uint8_t layer, SDL_Texture *texture, size_t count)
+{
+  RenderCommand *last = queue->commands->size > queue->pass ? RenderCommand_vector_back(queue->commands) : NULL;
+
+  if (last != NULL && last->layer == layer && last->texture == texture && last->first + last->count == queue->vertices->size)
+    last->count += count;
+  else
+    RenderCommand_vector_push(queue->commands, &(RenderCommand){layer, texture, queue->sequence++, queue->vertices->size, count});
+
+  return append_vertices(queue->vertices, count);
+}
+
+RenderPass RenderQueue_Begin(RenderQueue *queue)
+{
+  queue->pass = queue->commands->size;
+  return (RenderPass){queue->commands->size, queue->vertices->size};
+}
+
+// Draws every command recorded since pass began and drops them, returns the number of draw calls
+uint32_t RenderQueue_Submit(RenderQueue *queue, SDL_Renderer *renderer, RenderPass pass)
+{
+  RenderCommand *commands = queue->commands->data + pass.commands;
+  size_t count = queue->commands->size - pass.commands;
+  uint32_t draw_calls = 0;
+
+  qsort(commands, count, sizeof(*commands), (comparator_t)command_comparator);
+
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+  for (size_t i = 0; i < count;)
+  {
+    size_t j = i + 1;
+    while (j < count && commands[j].texture == commands[i].texture)
+      j++;
+
+    if (j == i + 1)
+    {
+      SDL_RenderGeometry(renderer, commands[i].texture, queue->vertices->data + commands[i].first, commands[i].count, NULL, 0);
+    }
+    else
+    {
+      Vertex_vector_clear(queue->batch);
+      for (size_t k = i; k < j; k++)
+        memcpy(append_vertices(queue->batch, commands[k].count), queue->vertices->data + commands[k].first, sizeof(Vertex) * commands[k].count);
+
+      SDL_RenderGeometry(renderer, commands[i].texture, queue->batch->data, queue->batch->size, NULL, 0);
+    }
+
+    draw_calls++;
+    i = j;
+  }
+
+  queue->commands->size = pass.commands;
+  queue->vertices->size = pass.vertices;
+  queue->pass = 0;
+
+  return draw_calls;
+}
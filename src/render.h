@@ -0,0 +1,43 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vector.h"
+
+typedef SDL_Vertex Vertex;
+VECTOR_DECL(Vertex)
+
+// Triangles drawn with one texture on one layer, sequence keeps emission order between equal keys
+typedef struct RenderCommand
+{
+  uint8_t layer;
+  SDL_Texture *texture; // NULL for untextured geometry
+  uint32_t sequence;
+  uint32_t first; // into RenderQueue.vertices
+  uint32_t count;
+} RenderCommand;
+VECTOR_DECL(RenderCommand)
+
+// Where a pass starts, passes nest so an offscreen target can be drawn while the frame is being recorded
+typedef struct RenderPass
+{
+  size_t commands;
+  size_t vertices;
+} RenderPass;
+
+// Per-frame command buffer, sorted by layer, then texture, then sequence and submitted as few SDL_RenderGeometry calls as possible
+typedef struct RenderQueue
+{
+  RenderCommand_vector *commands;
+  Vertex_vector *vertices;
+  Vertex_vector *batch; // vertices of adjacent commands merged into one draw call
+  size_t pass;          // commands below this index belong to an outer pass and are never extended
+  uint32_t sequence;
+} RenderQueue;
+
+void RenderQueue_Init(RenderQueue *queue);
+void RenderQueue_Free(RenderQueue *queue);
+Vertex *RenderQueue_Triangles(RenderQueue *queue, uint8_t layer, SDL_Texture *texture, size_t count);
+RenderPass RenderQueue_Begin(RenderQueue *queue);
+uint32_t RenderQueue_Submit(RenderQueue *queue, SDL_Renderer *renderer, RenderPass pass);
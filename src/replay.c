@@ -0,0 +1,240 @@
+#include "replay.h"
+#include <SDL2/SDL.h>
+#include <assert.h>
+#include <string.h>
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+  put_u16(p, v);
+  put_u16(p + 2, v >> 16);
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+  put_u32(p, v);
+  put_u32(p + 4, v >> 32);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+  return get_u16(p) | (uint32_t)get_u16(p + 2) << 16;
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+  return get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+static void write_header(Replay *replay, uint8_t *header)
+{
+  memcpy(header, REPLAY_MAGIC, 4);
+  put_u16(header + 4, REPLAY_VERSION);
+  header[6] = replay->level;
+  header[7] = replay->flags;
+  put_u32(header + 8, replay->seed);
+  put_u64(header + 12, replay->ticks);
+}
+
+static void flush_buffer(Replay *replay)
+{
+  if (replay->size > 0)
+    fwrite(replay->data, 1, replay->size, replay->file);
+  replay->size = 0;
+}
+
+static void put_byte(Replay *replay, uint8_t byte)
+{
+  if (replay->size == replay->capacity)
+    flush_buffer(replay);
+  replay->data[replay->size++] = byte;
+}
+
+static void put_varint(Replay *replay, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    put_byte(replay, value | 0x80);
+    value >>= 7;
+  }
+  put_byte(replay, value);
+}
+
+static bool get_varint(Replay *replay, uint32_t *value)
+{
+  *value = 0;
+  for (uint8_t shift = 0; shift < 35 && replay->cursor < replay->size; shift += 7)
+  {
+    uint8_t byte = replay->data[replay->cursor++];
+    *value |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static void flush_run(Replay *replay)
+{
+  if (replay->run == 0)
+    return;
+
+  put_byte(replay, replay->mask);
+  put_varint(replay, replay->run);
+  replay->run = 0;
+}
+
+bool Replay_Record(Replay *replay, const char *path, uint8_t level, uint8_t flags, uint32_t seed)
+{
+  memset(replay, 0, sizeof(*replay));
+
+  replay->file = fopen(path, "wb");
+  if (replay->file == NULL)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "REPLAY: could not create %s", path);
+    return false;
+  }
+
+  replay->data = SDL_malloc(REPLAY_BUFFER_SIZE);
+  assert(replay->data != NULL);
+  replay->capacity = REPLAY_BUFFER_SIZE;
+  replay->level = level;
+  replay->flags = flags;
+  replay->seed = seed;
+  replay->mode = REPLAY_RECORD;
+
+  // Placeholder, the tick count is patched in by Replay_Close
+  uint8_t header[REPLAY_HEADER_SIZE];
+  write_header(replay, header);
+  fwrite(header, 1, sizeof(header), replay->file);
+
+  SDL_Log("REPLAY: recording to %s", path);
+
+  return true;
+}
+
+void Replay_Input(Replay *replay, uint8_t mask)
+{
+  assert(replay->mode == REPLAY_RECORD);
+  assert(mask < REPLAY_EVENT);
+
+  replay->ticks++;
+
+  if (replay->run > 0 && replay->mask == mask && replay->run < UINT32_MAX)
+  {
+    replay->run++;
+    return;
+  }
+
+  flush_run(replay);
+  replay->mask = mask;
+  replay->run = 1;
+}
+
+void Replay_Key(Replay *replay, int32_t key)
+{
+  assert(replay->mode == REPLAY_RECORD);
+
+  flush_run(replay);
+  put_byte(replay, REPLAY_EVENT);
+  put_varint(replay, key);
+}
+
+bool Replay_Play(Replay *replay, const char *path)
+{
+  memset(replay, 0, sizeof(*replay));
+
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "REPLAY: could not open %s", path);
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  uint8_t *data = size >= REPLAY_HEADER_SIZE ? SDL_malloc(size) : NULL;
+  bool ok = data != NULL && fread(data, 1, size, file) == (size_t)size &&
+            !memcmp(data, REPLAY_MAGIC, 4) && get_u16(data + 4) == REPLAY_VERSION;
+  fclose(file);
+
+  if (!ok)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "REPLAY: %s is not a version %d replay", path, REPLAY_VERSION);
+    SDL_free(data);
+    return false;
+  }
+
+  replay->data = data;
+  replay->size = replay->capacity = size;
+  replay->cursor = REPLAY_HEADER_SIZE;
+  replay->level = data[6];
+  replay->flags = data[7];
+  replay->seed = get_u32(data + 8);
+  replay->ticks = get_u64(data + 12);
+  replay->mode = REPLAY_PLAY;
+
+  SDL_Log("REPLAY: playing %s (%llu ticks, level %d, seed %u)", path, replay->ticks, replay->level, replay->seed);
+
+  return true;
+}
+
+ReplayStep Replay_Next(Replay *replay, uint8_t *mask, int32_t *key)
+{
+  assert(replay->mode == REPLAY_PLAY);
+
+  while (replay->run == 0)
+  {
+    if (replay->cursor >= replay->size)
+      return REPLAY_END;
+
+    uint8_t byte = replay->data[replay->cursor++];
+    uint32_t value;
+    if (!get_varint(replay, &value))
+      return REPLAY_END;
+
+    if (byte == REPLAY_EVENT)
+    {
+      *key = value;
+      return REPLAY_KEY;
+    }
+
+    replay->mask = byte;
+    replay->run = value;
+  }
+
+  replay->run--;
+  *mask = replay->mask;
+  return REPLAY_INPUT;
+}
+
+void Replay_Close(Replay *replay)
+{
+  if (replay->mode == REPLAY_RECORD)
+  {
+    flush_run(replay);
+    flush_buffer(replay);
+
+    uint8_t header[REPLAY_HEADER_SIZE];
+    write_header(replay, header);
+    fseek(replay->file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), replay->file);
+    fclose(replay->file);
+
+    SDL_Log("REPLAY: recorded %llu ticks", replay->ticks);
+  }
+
+  SDL_free(replay->data);
+  memset(replay, 0, sizeof(*replay));
+}
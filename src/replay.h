@@ -0,0 +1,52 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define REPLAY_MAGIC "KDRP"
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 20
+#define REPLAY_BUFFER_SIZE (64 * 1024)
+#define REPLAY_EVENT 0x80
+
+#define REPLAY_AUTO_RESTART 0x01 // recorded headless, game over starts a new game
+
+typedef enum ReplayMode
+{
+  REPLAY_OFF,
+  REPLAY_RECORD,
+  REPLAY_PLAY,
+} ReplayMode;
+
+typedef enum ReplayStep
+{
+  REPLAY_INPUT,
+  REPLAY_KEY,
+  REPLAY_END,
+} ReplayStep;
+
+// Per-tick input masks as runs of (mask, varint length), key events as (REPLAY_EVENT, varint keycode).
+// Recording only touches the file when the buffer fills up and on Replay_Close.
+typedef struct Replay
+{
+  ReplayMode mode;
+  FILE *file;
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+  size_t cursor;
+  uint8_t level;
+  uint8_t flags;
+  uint32_t seed;
+  uint64_t ticks; // recorded so far, or total when playing
+  uint8_t mask;
+  uint32_t run; // ticks left in the current run
+} Replay;
+
+bool Replay_Record(Replay *replay, const char *path, uint8_t level, uint8_t flags, uint32_t seed);
+void Replay_Input(Replay *replay, uint8_t mask);
+void Replay_Key(Replay *replay, int32_t key);
+bool Replay_Play(Replay *replay, const char *path);
+ReplayStep Replay_Next(Replay *replay, uint8_t *mask, int32_t *key);
+void Replay_Close(Replay *replay);
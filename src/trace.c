@@ -0,0 +1,79 @@
+#include "trace.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+void Trace_Init(Trace *trace)
+{
+  memset(trace, 0, sizeof(*trace));
+
+  trace->events = SDL_malloc(sizeof(TraceEvent) * TRACE_CAPACITY);
+  assert(trace->events != NULL);
+  trace->origin = SDL_GetPerformanceCounter();
+  trace->thread = SDL_TLSCreate();
+}
+
+void Trace_Free(Trace *trace)
+{
+  SDL_free(trace->events);
+  memset(trace, 0, sizeof(*trace));
+}
+
+// Labels the calling thread in the written trace. Threads given the same name share one track, so a thread that is
+// restarted, like the simulation on every reload, stays on the track of the one it replaces.
+void Trace_NameThread(Trace *trace, const char *name)
+{
+  uint8_t slot = 0;
+  while (slot < trace->thread_count && strcmp(trace->thread_names[slot], name))
+    slot++;
+
+  if (slot == trace->thread_count)
+  {
+    assert(trace->thread_count < TRACE_THREADS);
+    trace->thread_names[trace->thread_count++] = name;
+  }
+
+  SDL_TLSSet(trace->thread, (void *)(uintptr_t)(slot + 1), NULL);
+}
+
+void Trace_Add(Trace *trace, uint16_t name, uint64_t start, uint64_t end)
+{
+  uint32_t slot = (uint32_t)SDL_AtomicAdd(&trace->next, 1) % TRACE_CAPACITY;
+  trace->events[slot] = (TraceEvent){start, end, (uintptr_t)SDL_TLSGet(trace->thread), name};
+}
+
+// Writes the events in the ring as Chrome trace event JSON, which chrome://tracing and Perfetto open
+bool Trace_Write(Trace *trace, const char *path, const char **names, uint16_t name_count)
+{
+  FILE *file = fopen(path, "w");
+  if (file == NULL)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "TRACE: could not create %s", path);
+    return false;
+  }
+
+  uint32_t next = SDL_AtomicGet(&trace->next);
+  uint32_t count = next < TRACE_CAPACITY ? next : TRACE_CAPACITY;
+  double us = 1e6 / SDL_GetPerformanceFrequency();
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (uint8_t i = 0; i < trace->thread_count; i++)
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", i + 1, trace->thread_names[i]);
+
+  // Oldest first
+  for (uint32_t i = next - count; i != next; i++)
+  {
+    TraceEvent *event = &trace->events[i % TRACE_CAPACITY];
+    fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n",
+            event->name < name_count ? names[event->name] : "?", event->thread,
+            (event->start - trace->origin) * us, (event->end - event->start) * us);
+  }
+
+  // Trailing commas are not valid JSON, so the array ends with metadata for the process
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"King Donkey\"}}\n]}\n");
+  fclose(file);
+
+  SDL_Log("TRACE: wrote %u events to %s", count, path);
+
+  return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRACE_CAPACITY (1 << 18) // events kept, about a minute of frames and ticks
+#define TRACE_THREADS 4 // distinct thread names
+
+typedef struct TraceEvent
+{
+  uint64_t start; // performance counter
+  uint64_t end;
+  uint16_t thread; // 1 + index into thread_names, 0 for a thread that was never named
+  uint16_t name;   // index into the names passed to Trace_Write
+} TraceEvent;
+
+// Timed events recorded into a preallocated ring by any thread, the oldest are overwritten once it is full.
+// Nothing is formatted until Trace_Write, which must not run while other threads are still adding events.
+typedef struct Trace
+{
+  TraceEvent *events; // NULL while tracing is off
+  SDL_atomic_t next;
+  uint64_t origin; // performance counter at Trace_Init
+  SDL_TLSID thread; // the calling thread's TraceEvent.thread
+  const char *thread_names[TRACE_THREADS];
+  uint8_t thread_count;
+} Trace;
+
+void Trace_Init(Trace *trace);
+void Trace_Free(Trace *trace);
+void Trace_NameThread(Trace *trace, const char *name);
+void Trace_Add(Trace *trace, uint16_t name, uint64_t start, uint64_t end);
+bool Trace_Write(Trace *trace, const char *path, const char **names, uint16_t name_count);
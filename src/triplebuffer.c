@@ -0,0 +1,24 @@
+#include "triplebuffer.h"
+
+void TripleBuffer_Init(TripleBuffer *buffer)
+{
+  buffer->back = 0;
+  SDL_AtomicSet(&buffer->middle, 1);
+  buffer->front = 2;
+}
+
+// Makes back the newest slot and hands the writer whichever slot was in the middle
+void TripleBuffer_Publish(TripleBuffer *buffer)
+{
+  buffer->back = SDL_AtomicSet(&buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH) & ~TRIPLE_BUFFER_FRESH;
+}
+
+// Moves front to the newest published slot, returns false when nothing was published since the last call
+bool TripleBuffer_Acquire(TripleBuffer *buffer)
+{
+  if (!(SDL_AtomicGet(&buffer->middle) & TRIPLE_BUFFER_FRESH))
+    return false;
+
+  buffer->front = SDL_AtomicSet(&buffer->middle, buffer->front) & ~TRIPLE_BUFFER_FRESH;
+  return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRIPLE_BUFFER_FRESH 4 // set on middle while it holds a slot the reader hasn't taken
+
+// Hands whole slots from one writer thread to one reader thread without locks or waiting.
+// The writer fills back and swaps it with middle, the reader swaps front with middle whenever middle is fresh.
+typedef struct TripleBuffer
+{
+  SDL_atomic_t middle;
+  uint8_t back;  // owned by the writer
+  uint8_t front; // owned by the reader
+} TripleBuffer;
+
+void TripleBuffer_Init(TripleBuffer *buffer);
+void TripleBuffer_Publish(TripleBuffer *buffer);
+bool TripleBuffer_Acquire(TripleBuffer *buffer);
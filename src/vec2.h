@@ -1,21 +1,153 @@
 #pragma once
 #include <SDL2/SDL.h>
+#include <math.h>
+#include <stdint.h>
+
+#define VEC2_DOUBLE 0
+#define VEC2_FLOAT 1
+#define VEC2_FIXED 2 // 16.16
+
+#ifndef VEC2_PRECISION
+#define VEC2_PRECISION VEC2_DOUBLE
+#endif
+
+#if VEC2_PRECISION == VEC2_DOUBLE
+typedef double vec_t;
+#define VEC(d) ((vec_t)(d))
+#define VEC_TO_DOUBLE(v) ((double)(v))
+#define VEC_MUL(a, b) ((a) * (b))
+#define VEC_DIV(a, b) ((a) / (b))
+#define VEC_SQRT(a) sqrt(a)
+#elif VEC2_PRECISION == VEC2_FLOAT
+typedef float vec_t;
+#define VEC(d) ((vec_t)(d))
+#define VEC_TO_DOUBLE(v) ((double)(v))
+#define VEC_MUL(a, b) ((a) * (b))
+#define VEC_DIV(a, b) ((a) / (b))
+#define VEC_SQRT(a) sqrtf(a)
+#elif VEC2_PRECISION == VEC2_FIXED
+typedef int32_t vec_t;
+#define VEC_ONE 65536
+#define VEC(d) ((vec_t)((d) * VEC_ONE))
+#define VEC_TO_DOUBLE(v) ((double)(v) / VEC_ONE)
+#define VEC_MUL(a, b) ((vec_t)(((int64_t)(a) * (b)) >> 16))
+#define VEC_DIV(a, b) ((vec_t)((int64_t)(a) * VEC_ONE / (b)))
+#define VEC_SQRT(a) Vec_SqrtFixed(a)
+
+// Square root of a 16.16 value held in 64 bits, so it also takes squared lengths beyond the 16.16 range
+static inline vec_t Vec_SqrtFixed(int64_t a)
+{
+  if (a <= 0)
+    return 0;
+
+  uint64_t n = (uint64_t)a << 16, root = 0, bit = 1ull << 62;
+  while (bit > n)
+    bit >>= 2;
+
+  for (; bit != 0; bit >>= 2)
+  {
+    if (n >= root + bit)
+    {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+  }
+  return (vec_t)root;
+}
+#else
+#error "VEC2_PRECISION must be VEC2_DOUBLE, VEC2_FLOAT or VEC2_FIXED"
+#endif
 
 typedef struct Vec2
 {
-  double x;
-  double y;
+  vec_t x;
+  vec_t y;
 } Vec2;
 
-Vec2 Vec2_Copy(Vec2 a);
-Vec2 Vec2_Add(Vec2 a, Vec2 b);
-Vec2 Vec2_Sub(Vec2 a, Vec2 b);
-Vec2 Vec2_Mul(Vec2 a, double b);
-Vec2 Vec2_Div(Vec2 a, double b);
-double Vec2_Dot(Vec2 a, Vec2 b);
-double Vec2_Len(Vec2 a);
-Vec2 Vec2_Normalize(Vec2 a);
-Vec2 Vec2_Lerp(Vec2 a, Vec2 b, double t);
-Vec2 Vec2_Rotate(Vec2 a, double angle);
-Vec2 Vec2_ClampRect(Vec2 a, SDL_Rect rect);
-SDL_Point Vec2_ToPoint(Vec2 a);
+static inline Vec2 Vec2_Copy(Vec2 a)
+{
+  return (Vec2){a.x, a.y};
+}
+
+static inline Vec2 Vec2_Add(Vec2 a, Vec2 b)
+{
+  return (Vec2){a.x + b.x, a.y + b.y};
+}
+
+static inline Vec2 Vec2_Sub(Vec2 a, Vec2 b)
+{
+  return (Vec2){a.x - b.x, a.y - b.y};
+}
+
+static inline Vec2 Vec2_Mul(Vec2 a, vec_t b)
+{
+  return (Vec2){VEC_MUL(a.x, b), VEC_MUL(a.y, b)};
+}
+
+static inline Vec2 Vec2_Div(Vec2 a, vec_t b)
+{
+  return (Vec2){VEC_DIV(a.x, b), VEC_DIV(a.y, b)};
+}
+
+#if VEC2_PRECISION == VEC2_FIXED
+// Products summed in 64 bits, a dot product leaves 16.16 once the vectors are longer than about 181
+static inline int64_t Vec2_DotWide(Vec2 a, Vec2 b)
+{
+  return ((int64_t)a.x * b.x >> 16) + ((int64_t)a.y * b.y >> 16);
+}
+
+static inline vec_t Vec2_Dot(Vec2 a, Vec2 b)
+{
+  int64_t dot = Vec2_DotWide(a, b);
+  return dot > INT32_MAX ? INT32_MAX : dot < INT32_MIN ? INT32_MIN : (vec_t)dot;
+}
+
+static inline vec_t Vec2_Len(Vec2 a)
+{
+  return Vec_SqrtFixed(Vec2_DotWide(a, a));
+}
+#else
+static inline vec_t Vec2_Dot(Vec2 a, Vec2 b)
+{
+  return a.x * b.x + a.y * b.y;
+}
+
+static inline vec_t Vec2_Len(Vec2 a)
+{
+  return VEC_SQRT(Vec2_Dot(a, a));
+}
+#endif
+
+static inline Vec2 Vec2_Normalize(Vec2 a)
+{
+  vec_t len = Vec2_Len(a);
+  return len ? Vec2_Div(a, len) : (Vec2){0};
+}
+
+static inline Vec2 Vec2_Lerp(Vec2 a, Vec2 b, vec_t t)
+{
+  return Vec2_Add(a, Vec2_Mul(Vec2_Sub(b, a), t));
+}
+
+static inline Vec2 Vec2_Rotate(Vec2 a, double angle)
+{
+  vec_t c = VEC(cos(angle));
+  vec_t s = VEC(sin(angle));
+  return (Vec2){VEC_MUL(a.x, c) - VEC_MUL(a.y, s), VEC_MUL(a.x, s) + VEC_MUL(a.y, c)};
+}
+
+static inline Vec2 Vec2_ClampRect(Vec2 a, SDL_Rect rect)
+{
+  vec_t x0 = VEC(rect.x), x1 = VEC(rect.x + rect.w);
+  vec_t y0 = VEC(rect.y), y1 = VEC(rect.y + rect.h);
+  return (Vec2){
+      a.x < x0 ? x0 : a.x > x1 ? x1 : a.x,
+      a.y < y0 ? y0 : a.y > y1 ? y1 : a.y};
+}
+
+static inline SDL_Point Vec2_ToPoint(Vec2 a)
+{
+  return (SDL_Point){VEC_TO_DOUBLE(a.x), VEC_TO_DOUBLE(a.y)};
+}
@@ -0,0 +1,132 @@
+#include "watch.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define WATCH_WRITTEN (IN_CLOSE_WRITE | IN_MOVED_TO) // a file that is complete, written in place or renamed over
+
+static bool ends_with(const char *name, const char *suffix)
+{
+  size_t length = strlen(name), suffix_length = strlen(suffix);
+  return length >= suffix_length && !strcmp(name + length - suffix_length, suffix);
+}
+
+bool Watcher_Init(Watcher *watcher, const char *library_dir, const char *library, const char *assets, const char *sources)
+{
+  memset(watcher, 0, sizeof(*watcher));
+  snprintf(watcher->library, sizeof(watcher->library), "%s", library);
+
+  watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watcher->fd < 0)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "WATCH: could not start inotify");
+    return false;
+  }
+
+  // The library's directory is watched rather than the file, the linker replaces it with a new one
+  watcher->library_dir = inotify_add_watch(watcher->fd, library_dir, WATCH_WRITTEN | IN_CREATE | IN_MODIFY);
+  watcher->assets = inotify_add_watch(watcher->fd, assets, WATCH_WRITTEN);
+  watcher->sources = inotify_add_watch(watcher->fd, sources, WATCH_WRITTEN);
+  if (watcher->library_dir < 0 || watcher->assets < 0)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "WATCH: could not watch %s and %s", library_dir, assets);
+    Watcher_Free(watcher);
+    return false;
+  }
+
+  SDL_Log("WATCH: reloading %s/%s and %s when they change", library_dir, library, assets);
+
+  return true;
+}
+
+void Watcher_Free(Watcher *watcher)
+{
+  if (watcher->fd >= 0)
+    close(watcher->fd);
+  watcher->fd = -1;
+}
+
+static void add_changed(Watcher *watcher, const char *name)
+{
+  for (uint8_t i = 0; i < watcher->changed_count; i++)
+    if (!strcmp(watcher->changed[i], name))
+      return;
+
+  if (watcher->changed_count < WATCH_ASSETS && strlen(name) < WATCH_NAME_SIZE)
+    strcpy(watcher->changed[watcher->changed_count++], name);
+}
+
+static void handle_event(Watcher *watcher, const struct inotify_event *event, uint64_t now)
+{
+  if (event->len == 0)
+    return;
+
+  if (event->wd == watcher->library_dir && !strcmp(event->name, watcher->library))
+    watcher->written = event->mask & WATCH_WRITTEN ? now : 0;
+  else if (event->wd == watcher->assets)
+    add_changed(watcher, event->name);
+  else if (event->wd == watcher->sources && watcher->saved == 0 && (ends_with(event->name, ".c") || ends_with(event->name, ".h")))
+    watcher->saved = now;
+}
+
+// Reads what happened since the last poll, returns whether the library was written and has been left alone since
+bool Watcher_Poll(Watcher *watcher)
+{
+  watcher->changed_count = 0;
+  if (watcher->fd < 0)
+    return false;
+
+  uint64_t now = SDL_GetPerformanceCounter();
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t length;
+
+  while ((length = read(watcher->fd, buffer, sizeof(buffer))) > 0)
+  {
+    for (char *p = buffer; p < buffer + length;)
+    {
+      const struct inotify_event *event = (const struct inotify_event *)p;
+      handle_event(watcher, event, now);
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  return watcher->written != 0 && now - watcher->written >= SDL_GetPerformanceFrequency() * WATCH_SETTLE_MS / 1000;
+}
+#else
+bool Watcher_Init(Watcher *watcher, const char *library_dir, const char *library, const char *assets, const char *sources)
+{
+  memset(watcher, 0, sizeof(*watcher));
+  watcher->fd = -1;
+  SDL_Log("WATCH: not supported on this platform, press F5 to reload");
+  return false;
+}
+
+void Watcher_Free(Watcher *watcher)
+{
+}
+
+bool Watcher_Poll(Watcher *watcher)
+{
+  watcher->changed_count = 0;
+  return false;
+}
+#endif
+
+// Logs how long the new code took to start running, after the first save that led to it when one was seen
+void Watcher_Reloaded(Watcher *watcher, uint64_t start)
+{
+  uint64_t now = SDL_GetPerformanceCounter();
+  double ms = SDL_GetPerformanceFrequency() / 1000.0;
+
+  if (watcher->saved != 0 && watcher->saved <= watcher->written)
+    SDL_Log("WATCH: new code running %.0f ms after the save (build %.0f ms, settle %.0f ms, swap %.1f ms)",
+            (now - watcher->saved) / ms, (watcher->written - watcher->saved) / ms, (start - watcher->written) / ms, (now - start) / ms);
+  else if (watcher->written != 0)
+    SDL_Log("WATCH: new code running %.0f ms after the library was written (swap %.1f ms)", (now - watcher->written) / ms, (now - start) / ms);
+
+  watcher->saved = 0;
+  watcher->written = 0;
+}
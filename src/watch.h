@@ -0,0 +1,28 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WATCH_SETTLE_MS 50 // quiet time after the library is written before it is loaded
+#define WATCH_NAME_SIZE 64
+#define WATCH_ASSETS 16 // distinct assets reported per poll, the rest are dropped
+
+// Watches the game library, the assets and the sources with inotify, polled once per frame without blocking.
+// Only available on Linux, elsewhere nothing is reported and F5 is the only way to reload.
+typedef struct Watcher
+{
+  int fd; // inotify instance, -1 when not watching
+  int library_dir;
+  int assets;
+  int sources;
+  char library[WATCH_NAME_SIZE];
+  uint64_t saved;   // performance counter at the first source save since the last reload, 0 if none
+  uint64_t written; // when the library was last closed after writing, 0 while no reload is pending
+  char changed[WATCH_ASSETS][WATCH_NAME_SIZE]; // assets written since the previous poll
+  uint8_t changed_count;
+} Watcher;
+
+bool Watcher_Init(Watcher *watcher, const char *library_dir, const char *library, const char *assets, const char *sources);
+void Watcher_Free(Watcher *watcher);
+bool Watcher_Poll(Watcher *watcher);
+void Watcher_Reloaded(Watcher *watcher, uint64_t start);
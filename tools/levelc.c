@@ -0,0 +1,73 @@
+// Compiles the text levels into the binary form the game copies out of the pack (./nobuild pack)
+// Usage: levelc <output dir> <levels...>, assets/level1.kd becomes <output dir>/level1.kdl
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "game.h"
+
+VECTOR_IMPL(Entity)
+
+static bool compile(const char *input, const char *output)
+{
+  FILE *file = fopen(input, "r");
+  if (file == NULL)
+  {
+    fprintf(stderr, "%s: could not read\n", input);
+    return false;
+  }
+
+  Level level = {
+      .platforms = Entity_vector_new(),
+      .ladders = Entity_vector_new(),
+      .collectibles = Entity_vector_new()};
+
+  int line = Level_Parse(&level, file, GRID_SIZE);
+  fclose(file);
+
+  bool ok = line == 0;
+  if (!ok)
+    fprintf(stderr, "%s:%d: expected a type, pos(x y) or size(w h)\n", input, line);
+
+  if (ok)
+  {
+    file = fopen(output, "wb");
+    ok = file != NULL && Level_Write(&level, file, GRID_SIZE);
+    if (file != NULL)
+      fclose(file);
+    if (!ok)
+      fprintf(stderr, "%s: could not write\n", output);
+  }
+
+  if (ok)
+    printf("Compiled %s into %s (%zu platforms, %zu ladders, %zu collectibles)\n", input, output,
+           level.platforms->size, level.ladders->size, level.collectibles->size);
+
+  Entity_vector_free(level.platforms);
+  Entity_vector_free(level.ladders);
+  Entity_vector_free(level.collectibles);
+
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: %s <output dir> <levels...>\n", argv[0]);
+    return 1;
+  }
+
+  for (int i = 2; i < argc; i++)
+  {
+    const char *slash = strrchr(argv[i], '/');
+    const char *name = slash != NULL ? slash + 1 : argv[i];
+
+    char output[256];
+    snprintf(output, sizeof(output), "%s/%sl", argv[1], name);
+    if (!compile(argv[i], output))
+      return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+// Packs files into one indexed archive the game maps at startup (./nobuild pack)
+// Usage: pack <output> <files...>, each file is stored under its base name
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pack.h"
+
+typedef struct Input
+{
+  const char *path;
+  PackEntry entry;
+  uint8_t *data;
+} Input;
+
+static int compare_input(const void *a, const void *b)
+{
+  return strcmp(((const Input *)a)->entry.name, ((const Input *)b)->entry.name);
+}
+
+static uint8_t *read_file(const char *path, uint32_t *size)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  uint8_t *data = malloc(length > 0 ? length : 1);
+  if (data != NULL && fread(data, 1, length, file) != (size_t)length)
+  {
+    free(data);
+    data = NULL;
+  }
+  fclose(file);
+
+  *size = length;
+  return data;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: %s <output> <files...>\n", argv[0]);
+    return 1;
+  }
+
+  int count = argc - 2;
+  Input *inputs = calloc(count, sizeof(Input));
+
+  for (int i = 0; i < count; i++)
+  {
+    Input *input = &inputs[i];
+    input->path = argv[i + 2];
+
+    const char *slash = strrchr(input->path, '/');
+    const char *name = slash != NULL ? slash + 1 : input->path;
+    if (strlen(name) >= PACK_NAME_SIZE)
+    {
+      fprintf(stderr, "%s: name longer than %d characters\n", name, PACK_NAME_SIZE - 1);
+      return 1;
+    }
+    strcpy(input->entry.name, name);
+
+    input->data = read_file(input->path, &input->entry.size);
+    if (input->data == NULL)
+    {
+      fprintf(stderr, "%s: could not read\n", input->path);
+      return 1;
+    }
+  }
+
+  // The game looks names up with a binary search
+  qsort(inputs, count, sizeof(Input), compare_input);
+
+  uint32_t offset = sizeof(PackHeader) + sizeof(PackEntry) * count;
+  for (int i = 0; i < count; i++)
+  {
+    if (i > 0 && !strcmp(inputs[i].entry.name, inputs[i - 1].entry.name))
+    {
+      fprintf(stderr, "%s: packed twice\n", inputs[i].entry.name);
+      return 1;
+    }
+
+    offset = (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+    inputs[i].entry.offset = offset;
+    offset += inputs[i].entry.size;
+  }
+
+  // Written next to the output and renamed over it, a running game keeps its mapping of the old pack
+  char temporary[4096];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", argv[1]);
+
+  FILE *file = fopen(temporary, "wb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "%s: could not create\n", temporary);
+    return 1;
+  }
+
+  PackHeader header = {.version = PACK_VERSION, .count = count};
+  memcpy(header.magic, PACK_MAGIC, 4);
+  fwrite(&header, sizeof(header), 1, file);
+  for (int i = 0; i < count; i++)
+    fwrite(&inputs[i].entry, sizeof(PackEntry), 1, file);
+
+  static const uint8_t padding[PACK_ALIGN] = {0};
+  for (int i = 0; i < count; i++)
+  {
+    fwrite(padding, 1, inputs[i].entry.offset - ftell(file), file);
+    fwrite(inputs[i].data, 1, inputs[i].entry.size, file);
+    free(inputs[i].data);
+  }
+
+  fclose(file);
+  free(inputs);
+
+  if (rename(temporary, argv[1]) != 0)
+  {
+    fprintf(stderr, "%s: could not replace\n", argv[1]);
+    return 1;
+  }
+
+  printf("Packed %d files into %s (%u bytes)\n", count, argv[1], offset);
+
+  return 0;
+}
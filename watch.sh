@@ -1,5 +1,3 @@
-#!/bin/zsh
-./nobuild run &
-if [ $? -eq 0 ]; then
-  fswatch -o ./src | xargs -n1 -I{} ./nobuild build
-fi
+#!/bin/sh
+# The game reloads itself when the library or an asset changes, nobuild watch rebuilds the library on save
+exec ./nobuild watch